@@ -8,279 +8,4537 @@
 *          such as the glider gun                            *
 *  2. Advanced life features are uploaded as life_extra.c    *
 *     and implement Immigration Life and Color Cycle Life    *
+*  3. a bit-packed engine (64 cells per word), the original  *
+*     cell-per-int engine is kept as scalar_engine. Every    *
+*     engine is picked with -E by name, or fixed when        *
+*     compiling so its tests fold away:                      *
+*          ./life -E block -b                                *
+*          gcc -DENGINE=hash_engine ...                      *
+*  4. a SIMD engine (simd_engine) that sums whole row strips *
+*     with SSE2/AVX2, picked at start up by CPUID            *
+*  5. the board size is chosen at run time:                  *
+*          ./life [rows columns]        (default 60 x 80)    *
+*     boards come from one cache-line aligned arena          *
+*  6. generations can be split across a pool of threads:     *
+*          ./life [rows columns [threads]]                   *
+*  7. a HashLife engine (hash_engine) that jumps 2^k         *
+*     generations at once on an unbounded plane, and a start *
+*     generation to jump to before the board is shown:       *
+*          ./life [rows columns [threads [start]]]           *
+*  8. the cell-per-int engine splits the board into tiles    *
+*     and only recomputes tiles next to a change             *
+*  9. a headless mode and a benchmark suite, picked with     *
+*     options ahead of the board size:                       *
+*          ./life -n [-g gens] [-d density] [-s seed]        *
+*                    [-k pattern] [rows columns ...]         *
+*          ./life -b [rows columns [threads]]                *
+* 10. the board is drawn into a frame buffer and only the    *
+*     squares that changed are sent, in a single write       *
+* 11. a run ends once the board repeats with any period up   *
+*     to -p (default 64), found from a hash of each board    *
+* 12. the live cells, births and deaths of each generation   *
+*     are counted by the engines as they step                *
+* 13. patterns are read from RLE or Life 1.06 files, placed  *
+*     at any offset, and the last board can be written out: *
+*          ./life -f file [-x column] [-y row] [-w file] ... *
+* 14. a binary checkpoint is written in the background every *
+*     -i generations and at the end, and a run resumes from  *
+*     one by mapping it as the first board:                  *
+*          ./life -c file [-i generations] ...               *
+*          ./life -r file ...                                *
+* 15. any outer totalistic rule, given as a rulestring and   *
+*     compiled into tables that every engine steps with.     *
+*     B3/S23 keeps kernels of its own:                       *
+*          ./life -l B36/S23 ...                             *
+* 16. a block engine (block_engine) on the bit-packed board  *
+*     that steps 2x2 cells at a time, looking each up from   *
+*     their 4x4 neighbourhood in a table of all 65536        *
+* 17. the random fill only hangs on -s: each row draws whole *
+*     words from a stream of its own, so the threads fill    *
+*     their bands of a bit-packed board side by side         *
+* 18. a sparse engine (sparse_engine) on an unbounded plane  *
+*     that only keeps the 64x64 tiles holding live cells, in *
+*     an open addressing hash table                          *
+* 19. temporal blocking on the bit-packed engine: runs that  *
+*     do not look for cycles take each band of rows -t       *
+*     generations on while it is in cache:                   *
+*          ./life -n -p 0 -t 8 ...                           *
+* 20. a headless run split across -P processes, each owning  *
+*     a slab of rows and swapping ghost rows with the ranks  *
+*     either side through shared memory or Unix sockets:     *
+*          ./life -n -p 0 -P 4 [-T shm|socket] ...           *
+* 21. built with -DPROFILE=1, the phases of a displayed run  *
+*     are timed each generation and written with counters    *
+*     and histograms as CSV or JSON lines:                   *
+*          gcc -DPROFILE=1 ... && ./life -o profile.csv ...  *
+* 22. the board is drawn on a thread of its own, from        *
+*     snapshots the run leaves in a lock-free ring, so a     *
+*     slow terminal drops frames instead of generations      *
+* 23. a displayed run can draw -v frames a second, stepping  *
+*     as many generations between them as there is time      *
+*     for, and step -u generations first without drawing:    *
+*          ./life -v 30 -u 10000 ...                         *
+* 24. a headless run can write every generation as a stream  *
+*     of PGM frames, and as a log of the words that changed  *
+*     run-length encoded, to a file or stdout:               *
+*          ./life -n -a - ... | ffmpeg -f image2pipe ...     *
+*          ./life -n -j run.delta ...                        *
 **************************************************************
-*  NOTE please compile using -w for nanosleep                *
+*  NOTE please compile with life_common.c and -pthread:      *
+*          gcc -O2 -pthread life.c life_common.c -o life     *
 *************************************************************/
 
-#include<stdio.h>
-#include<stdlib.h>
-#include<time.h>
-#include<sys/ioctl.h>
+#include "life_common.h"
+#include<limits.h>
+#include<sys/socket.h>
+#include<sys/wait.h>
+#include<poll.h>
+#include<errno.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include<cpuid.h>
+#include<immintrin.h>
+#endif
 
-#define ROWS 60
-#define COLUMNS 80
+#define DEFAULT_ROWS 60
+#define DEFAULT_COLUMNS 80
 #define DENSITY 5
 #define COLOR_DENSITY 2
 #define GENERATIONS 500
 #define QUARTER 4
 #define HALF 2
+#define DEFAULT_ROW_WORDS ((DEFAULT_COLUMNS + WORD_BITS - 1) / WORD_BITS)
+#define DEFAULT_LAST_BITS (DEFAULT_COLUMNS - \
+                           (DEFAULT_ROW_WORDS - 1) * WORD_BITS)
+#define STRIP_LANES 32
+#define TILE_SIZE 16
+#define BENCH_SEED 1
+#define BENCH_WARMUP 16
+#define BENCH_REPEATS 5
+#define BENCH_CELL_UPDATES (1 << 26)
+#define HASH_MAX_NODES (1 << 21)
+#define HASH_BLOCK 4096
+#define HASH_MAX_LEVEL 80
+#define MAX_PERIOD 64
+#define PATTERN_LINE 70
+#define CHECKPOINT_LIFE 2
+#define BLOCK_TABLE (1 << 16)
+#define TEMPORAL_BYTES (1 << 20)
+#define SPARSE_TILE WORD_BITS
+#define SPARSE_MIN_SLOTS 64
+#define SPARSE_MAPS 4
+#define HALO_TRANSPORT "shm"
+#define SNAPSHOT_SLOTS 4
+#define RENDER_POLL_NS 2000000
+/* the engine is picked with -E at run time, unless -DENGINE=... */
+/* fixes it when compiling so that every test of it folds away    */
+#ifndef ENGINE
+#define ENGINE options.engine
+#endif
+/* the engines that keep the board as bit-packed rows */
+#define BIT_ENGINE (ENGINE == bitpack_engine || ENGINE == block_engine)
+/* row r of each board layout, and cell (r, c) of a cell board */
+#define AT(board, r, c) ((board)[(size_t)(r) * dims.columns + (c)])
+#define BIT_ROW(bits, r) ((bits) + (size_t)(r) * dims.row_words)
+#define STRIP_ROW(strips, r) ((strips) + (size_t)(r) * dims.strip_width)
+/* flag of the tile holding cell (r, c) */
+#define TILE_AT(flags, r, c) ((flags)[(r) / TILE_SIZE * dims.tile_columns \
+                                      + (c) / TILE_SIZE])
+/* the sparse tile holding plane row or column x, rounding down */
+#define SPARSE_TILE_OF(x) ((x) >= 0 ? (int64_t)(x) / SPARSE_TILE \
+                                    : -((-(int64_t)(x) - 1) / SPARSE_TILE) - 1)
 
-enum cell_state {dead = 0, alive = 1, set_alive = 3, hold = 4};
-enum color {red, yellow, blue, mild_blue, normal};
-typedef enum color color;
-enum bool {false, true};
-typedef enum bool bool; 
 enum start_choice {known_start, random_start};
 enum known_type {glider, small_explosion, explosion, ten_cell, 
                  light_spaceship, glider_gun};
 typedef enum known_type known_type; 
-typedef int cell;
 typedef int state; 
-typedef int choice;
-struct timespec {
-   time_t tv_sec;
-   long tv_nsec;
+typedef unsigned char strip_cell;
+typedef unsigned char tile_flag;
+enum tile_state {tile_still, tile_changed, tile_filled};
+enum engine_type {scalar_engine, bitpack_engine, simd_engine, hash_engine,
+                  block_engine, sparse_engine};
+typedef void (*strip_kernel_func)(strip_cell *up, strip_cell *mid,
+                                  strip_cell *down, strip_cell *next);
+struct _dimensions {
+   int rows;
+   int columns;
+   int row_words;   /* bitwords in a packed row                */
+   int last_bits;   /* columns held by the last word of a row  */
+   int strip_width; /* bytes in a simd strip row, with padding */
+   int tile_rows;   /* TILE_SIZE square tiles down the board   */
+   int tile_columns;/* and across it                           */
+   int plane_rows;  /* rows of the whole board, more than rows */
+   int plane_first; /* on a rank: the first plane row it owns, */
+   int slab_first;  /* held in this row, up to the last row    */
 };
-typedef struct timespec timespec;
+typedef struct _dimensions dimensions;
+struct _hnode {
+   /* a 2^level square of the plane, or a single cell at level 0 */
+   struct _hnode *nw, *ne, *sw, *se;
+   struct _hnode *result;      /* centre after 2^(level-2) gens */
+   struct _hnode *step_result; /* centre after 2^step_log2 gens */
+   struct _hnode *chain;       /* next in bucket or free list   */
+   uint64_t population;
+   int level;
+   int step_log2;
+   bool marked;
+};
+typedef struct _hnode hnode;
+struct _hash_cache {
+   hnode **table;
+   size_t buckets;   /* a power of two              */
+   size_t count;     /* nodes held by the table     */
+   hnode *free_list;
+   hnode **blocks;
+   int block_count;
+   hnode leaf[2];    /* the dead and the alive cell */
+   hnode *empty[HASH_MAX_LEVEL];
+   struct _gen_board *keep;    /* boards held outside the run, */
+   int keep_count;             /* by the cycle ring            */
+   size_t limit;     /* count at which a step gives up  */
+};
+typedef struct _hash_cache hash_cache;
+struct _sparse_tile {
+   /* SPARSE_TILE square cells of the plane, bit c of bits[r] is */
+   /* cell (row * SPARSE_TILE + r, col * SPARSE_TILE + c)         */
+   int64_t row, col;
+   int population;
+   struct _sparse_tile *next;  /* in the free list */
+   bitword bits[SPARSE_TILE];
+};
+typedef struct _sparse_tile sparse_tile;
+struct _sparse_map {
+   /* the tiles of a plane, by open addressing on (row, col) */
+   sparse_tile **slots;  /* capacity of them, NULL where free   */
+   size_t capacity;      /* a power of two, at most half used   */
+   sparse_tile **list;   /* the count tiles held, to walk them  */
+   size_t count;
+};
+typedef struct _sparse_map sparse_map;
+struct _sparse_store {
+   /* tiles no plane is using, and the maps to free at the end */
+   sparse_tile *free_list;
+   size_t free_count;
+   sparse_map **maps;
+   int map_count;
+   int map_slots;
+};
+typedef struct _sparse_store sparse_store;
+struct _gen_stats {
+   /* census of a board, kept up as it is made */
+   uint64_t generation;
+   int64_t population;  /* live cells                           */
+   int64_t births;      /* cells that came alive in this step    */
+   int64_t deaths;      /* cells that died in this step          */
+};
+typedef struct _gen_stats gen_stats;
+struct _tile_census {
+   int births;          /* of the last step that made the tile   */
+   int deaths;
+};
+typedef struct _tile_census tile_census;
+struct _band_share {
+   /* what one band of rows adds to the next board */
+   uint64_t hash;
+   int64_t births;
+   int64_t deaths;
+   int64_t population;  /* only counted by a temporally blocked step */
+   int64_t evaluated;   /* cells stepped, with PROFILE                */
+   int64_t skipped;     /* tiles left as they were, with PROFILE      */
+};
+typedef struct _band_share band_share;
+struct _gen_board {
+   /* only the layout used by ENGINE is allocated */
+   cell *cells;
+   tile_flag *changed; /* tiles that differ from two boards ago */
+   tile_census *census;/* births and deaths in each tile        */
+   bitword *bits;
+   strip_cell *strips;
+   hnode *root;
+   sparse_map plane;
+   uint64_t hash;      /* of the cells, set by step_board */
+   gen_stats stats;    /* set by step_board and set_cell  */
+};
+typedef struct _gen_board gen_board;
+struct _cycle_ring {
+   /* the cycle log, and one board kept from a hit until it should */
+   /* come round again                                             */
+   cycle_log log;
+   arena store;
+   gen_board kept;
+};
+typedef struct _cycle_ring cycle_ring;
+struct _pool_job {
+   /* what the worker pool is posted to do */
+   gen_board *current;
+   gen_board *next;
+   band_share *shares;        /* each band's hash and census      */
+   int generations;
+   int depth;                 /* generations per temporal block    */
+   bitword *scratch;          /* TEMPORAL_BYTES a band, with -t    */
+   gen_board *fill;           /* filled at random instead, or NULL */
+};
+typedef struct _pool_job pool_job;
+struct _halo_link;
+struct _halo_transport {
+   /* how the ranks of a decomposed run reach each other. open is */
+   /* called before the ranks fork and attach, if there is one,   */
+   /* in each of them                                             */
+   char *name;
+   void (*open)(struct _halo_link *link);
+   void (*attach)(struct _halo_link *link);
+   void (*exchange)(struct _halo_link *link, gen_board *board);
+   void (*gather)(struct _halo_link *link, gen_board *board,
+                  band_share *share);
+   void (*close)(struct _halo_link *link);
+};
+typedef struct _halo_transport halo_transport;
+struct _halo_link {
+   int rank;
+   int ranks;
+   int first;                 /* rows owned, first .. last-1         */
+   int last;
+   int halo;                  /* ghost rows kept on either side      */
+   int pad;                   /* rows ahead of the slab in its board */
+   size_t row_bytes;
+   halo_transport *transport;
+   /* shm: the mapping every rank shares, carved up at open */
+   unsigned char *shared;
+   size_t shared_bytes;
+   pthread_barrier_t *barrier;
+   band_share *shares;        /* each rank's census, for the gather  */
+   unsigned char *slots;      /* edge rows, by parity, rank and side */
+   int parity;                /* the set of slots written next       */
+   unsigned char *staging;    /* one slab on its way to rank 0       */
+   /* socket: a ring of pairs, and a pair from each rank to rank 0 */
+   int *fds;
+   int up, down, report;
+   unsigned char *above;      /* ghost rows as they come in          */
+   unsigned char *below;
+};
+typedef struct _halo_link halo_link;
+struct _snapshot {
+   /* what one frame shows, copied out of a board */
+   bitword *cells;            /* one bit a square, rows of row_words */
+   int64_t population;
+   uint64_t generation;
+};
+typedef struct _snapshot snapshot;
+struct _snapshot_ring {
+   /* boards on their way from the run to the render thread */
+   snapshot slots[SNAPSHOT_SLOTS];
+   volatile uint64_t head;    /* snapshots published, by the run     */
+   volatile uint64_t tail;    /* snapshots drawn or passed over      */
+   volatile int done;         /* the run has published its last      */
+   uint64_t dropped;          /* boards the run found no slot for    */
+   uint64_t passed;           /* snapshots newer ones were drawn for */
+   frame *screen;
+   pthread_t thread;
+};
+typedef struct _snapshot_ring snapshot_ring;
+struct _frame_export {
+   /* where a headless run writes each generation, with -a and -j */
+   FILE *image;              /* PGM frames, or NULL                */
+   FILE *delta;              /* delta log, or NULL                 */
+   snapshot shot;            /* the generation being written       */
+   bitword *shown;           /* the one before, for the delta log  */
+   unsigned char *pixels;    /* one row of a frame                 */
+   unsigned char bytes[256][8]; /* the pixels of each byte of a row */
+};
+typedef struct _frame_export frame_export;
+struct _run_options {
+   bool headless;    /* no intro, prompts, console or delay     */
+   int generations;  /* generations to run                      */
+   int density;      /* 1 in density cells start alive          */
+   unsigned seed;    /* for the random fill                     */
+   int pattern;      /* known_type to start from, -1 for random */
+   uint64_t start;   /* generation to jump to before the run    */
+   int max_period;   /* longest cycle looked for, 0 for none    */
+   char *file;       /* pattern file to start from, or NULL     */
+   int row, column;  /* where the pattern's top left cell goes  */
+   char *out;        /* pattern file the last board goes to     */
+   char *checkpoint; /* checkpoint file written during the run  */
+   int interval;     /* generations between checkpoints, 0 end  */
+   char *resume;     /* checkpoint file to resume from          */
+   char *rule;       /* rulestring, B3/S23 unless -l is given   */
+   int depth;        /* generations a band takes while in cache */
+   int ranks;        /* processes the board is split over, or 0 */
+   char *transport;  /* how they swap ghost rows: shm or socket */
+   char *profile;    /* where -o sends phase timings, or NULL   */
+   int frame_rate;   /* frames a second, 0 for every generation */
+   int turbo;        /* generations stepped before any frame    */
+   char *image;      /* PGM frames of a headless run, or NULL   */
+   char *delta;      /* delta log of a headless run, or NULL    */
+   int engine;       /* engine_type of the run, from -E         */
+};
+typedef struct _run_options run_options;
+
+/* LIFE PRIMARY FUNCTIONS */
+void life(choice start_state);
+int sum_cells(cell *board, cell row, cell col);
+state next_cell_state(int sum, state current_state);
+cell read_toroidal(cell *board, cell row, cell col);
+void gen_next_rows(cell *current_board, cell *next_board, int first,
+                   int last);
+bool tile_active(tile_flag *changed, int tile_row, int tile_col);
+void gen_next_tiles(gen_board *current, gen_board *next, int first,
+                    int last, band_share *share);
+void step_board(gen_board *current, gen_board *next);
+void step_board_deep(gen_board *current, gen_board *next, int depth);
+void step_rows(gen_board *current, gen_board *next, int first, int last,
+               band_share *share);
+uint64_t jump_board(gen_board *current, gen_board *next,
+                    uint64_t generations);
+/* CYCLE DETECTION FUNCTIONS */
+uint64_t cycle_hash_rows(gen_board *board, int first, int last);
+void copy_board(gen_board *to, gen_board *from);
+void cycle_create(cycle_ring *ring, int size, gen_board *first);
+void cycle_destroy(cycle_ring *ring);
+int cycle_check(cycle_ring *ring, gen_board *board);
+/* RANDOM FILL FUNCTIONS */
+int64_t fill_rows(gen_board *board, int first, int last);
+/* HEADLESS AND BENCHMARK FUNCTIONS */
+void print_usage(char *name);
+bool parse_number(char *text, long long low, long long high,
+                  long long *value);
+bool parse_int(char *text, int *value);
+void fill_board(gen_board *board, int pattern);
+void headless(void);
+void benchmark(void);
+void bench_case(int rows, int columns, int density, int pattern);
+/* WORKER POOL FUNCTIONS */
+void job_create(pool_job *j, int threads);
+void job_destroy(pool_job *j);
+void pool_run(worker_pool *p, gen_board *current, gen_board *next,
+              int generations);
+void pool_fill(worker_pool *p, gen_board *board);
+void pool_work(worker_pool *p, int index);
+/* DOMAIN DECOMPOSITION FUNCTIONS */
+void domain_run(void);
+void domain_rank(halo_link *link);
+void domain_slab(halo_link *link, int rank, int *first, int *last);
+void domain_steps(halo_link *link, gen_board *current, gen_board *next,
+                  uint64_t generations, band_share *share);
+void *domain_row(gen_board *board, int r);
+void domain_ghosts(halo_link *link, gen_board *board, unsigned char *above,
+                   unsigned char *below);
+void halo_shm_open(halo_link *link);
+void halo_shm_exchange(halo_link *link, gen_board *board);
+void halo_shm_gather(halo_link *link, gen_board *board, band_share *share);
+void halo_shm_close(halo_link *link);
+void halo_socket_open(halo_link *link);
+void halo_socket_attach(halo_link *link);
+void halo_socket_exchange(halo_link *link, gen_board *board);
+void halo_socket_gather(halo_link *link, gen_board *board,
+                        band_share *share);
+void halo_socket_close(halo_link *link);
+void halo_socket_move(int fd, void *data, size_t bytes, bool out);
+/* BOARD STORAGE FUNCTIONS */
+bool set_dimensions(int rows, int columns);
+size_t board_bytes(void);
+void alloc_board(arena *a, gen_board *board);
+cell get_cell(gen_board *board, int row, int col);
+void set_cell(gen_board *board, int row, int col, cell value);
+int plane_row(long row);
+/* BIT-PACKED ENGINE FUNCTIONS */
+static ALWAYS_INLINE bitword bit_west(bitword *row, int w, int row_words,
+                                      int last_bits);
+static ALWAYS_INLINE bitword bit_east(bitword *row, int w, int row_words,
+                                      int last_bits);
+static ALWAYS_INLINE bitword bit_next_word(bitword *up, bitword *mid,
+                                           bitword *down, int w,
+                                           int row_words, int last_bits,
+                                           int life);
+static ALWAYS_INLINE int bit_count(bitword word, int hw);
+static ALWAYS_INLINE void bit_gen_rows(bitword *current_bits,
+                                       bitword *next_bits, int rows,
+                                       int row_words, int last_bits,
+                                       int first, int last,
+                                       band_share *share, int hw, int life);
+static ALWAYS_INLINE void bit_gen_shapes(bitword *current_bits,
+                                         bitword *next_bits, int rows,
+                                         int first, int last,
+                                         band_share *share, int hw);
+void select_bit_kernel(void);
+void bit_gen_next_board(bitword *current_bits, bitword *next_bits,
+                        int rows, int first, int last, band_share *share);
+#ifdef HAVE_X86_SIMD
+void bit_gen_popcnt(bitword *current_bits, bitword *next_bits, int rows,
+                    int first, int last, band_share *share);
+#endif
+int bit_deep_limit(void);
+bitword *bit_deep_scratch(int bands);
+void bit_deep_rows(bitword *current_bits, bitword *next_bits, int first,
+                   int last, int depth, bitword *scratch, band_share *share);
+/* BLOCK TABLE ENGINE FUNCTIONS */
+void block_init(void);
+static ALWAYS_INLINE unsigned block_nibble(bitword *row, int x);
+void block_gen_next_board(bitword *current_bits, bitword *next_bits,
+                          int first, int last, band_share *share);
+/* SIMD STRIP ENGINE FUNCTIONS */
+void select_strip_kernel(void);
+void strip_gen_next_board(strip_cell *current, strip_cell *next,
+                          int first, int last, band_share *share);
+void strip_census(strip_cell *old, strip_cell *new, band_share *share);
+void strip_kernel_scalar(strip_cell *up, strip_cell *mid, strip_cell *down,
+                         strip_cell *next);
+#ifdef HAVE_X86_SIMD
+int cpu_has_sse2(void);
+int cpu_has_avx2(void);
+int cpu_has_popcnt(void);
+void strip_kernel_sse2(strip_cell *up, strip_cell *mid, strip_cell *down,
+                       strip_cell *next);
+void strip_kernel_avx2(strip_cell *up, strip_cell *mid, strip_cell *down,
+                       strip_cell *next);
+void strip_rule_sse2(strip_cell *up, strip_cell *mid, strip_cell *down,
+                     strip_cell *next);
+void strip_rule_avx2(strip_cell *up, strip_cell *mid, strip_cell *down,
+                     strip_cell *next);
+#endif
+/* HASHLIFE ENGINE FUNCTIONS */
+void hash_init(void);
+void hash_destroy(void);
+hnode *hash_new_node(void);
+void hash_grow(void);
+hnode *hash_join(hnode *nw, hnode *ne, hnode *sw, hnode *se);
+int hash_min_level(void);
+hnode *hash_centre(hnode *n);
+hnode *hash_expand(hnode *n);
+hnode *hash_crop(hnode *n);
+cell hash_get(hnode *n, int64_t row, int64_t col);
+hnode *hash_set(hnode *n, int64_t row, int64_t col, cell value);
+hnode *hash_base(hnode *n);
+hnode *hash_successor(hnode *n, int j);
+hnode *hash_step(hnode *root, int j);
+hnode *hash_advance(hnode *root, uint64_t generations);
+hnode *hash_jump(hnode *root, int j);
+void hash_mark(hnode *n);
+void hash_collect(hnode *root);
+/* SPARSE TILE ENGINE FUNCTIONS */
+void sparse_init(sparse_map *map);
+void sparse_destroy(void);
+size_t sparse_slot(sparse_map *map, int64_t row, int64_t col);
+sparse_tile *sparse_find(sparse_map *map, int64_t row, int64_t col);
+sparse_tile *sparse_insert(sparse_map *map, int64_t row, int64_t col);
+void sparse_resize(sparse_map *map, size_t capacity);
+void sparse_clear(sparse_map *map);
+void sparse_trim(size_t keep);
+cell sparse_get(sparse_map *map, int64_t row, int64_t col);
+void sparse_set(sparse_map *map, int64_t row, int64_t col, cell value);
+void sparse_step(sparse_map *current, sparse_map *next, band_share *share);
+void sparse_tile_step(sparse_map *current, sparse_map *next, int64_t row,
+                      int64_t col, band_share *share);
+bool sparse_equal(sparse_map *a, sparse_map *b);
+void sparse_copy(sparse_map *to, sparse_map *from);
+uint64_t sparse_hash(sparse_map *map);
+/* PATTERN FILE FUNCTIONS */
+void load_pattern(gen_board *board, char *path, int row, int col);
+void pattern_parse(gen_board *board, char *p, char *end, int row, int col);
+void pattern_rle(gen_board *board, char *p, char *end, int row, int col);
+void pattern_life106(gen_board *board, char *p, char *end, int row,
+                     int col);
+void pattern_rule(char *p, char *end, char *key);
+char *pattern_line(char *p, char *end);
+bool pattern_number(char **p, char *end, long *value);
+void pattern_run(gen_board *board, long row, long col, long length);
+void save_pattern(gen_board *board, char *path);
+void write_rle(gen_board *board, FILE *out);
+void write_life106(gen_board *board, FILE *out);
+void rle_token(FILE *out, int count, char tag, int *width);
+/* CHECKPOINT FUNCTIONS */
+size_t checkpoint_plane_bytes(void);
+void checkpoint_tick(checkpoint *ck, gen_board *board);
+void checkpoint_post(checkpoint *ck, gen_board *board);
+void checkpoint_open(checkpoint_map *map, char *path);
+void checkpoint_restore(gen_board *board, checkpoint_map *map);
+/* RENDER THREAD FUNCTIONS */
+void render_start(snapshot_ring *r, frame *screen);
+void render_stop(snapshot_ring *r, gen_board *board);
+void render_publish(snapshot_ring *r, gen_board *board, bool wait);
+void snapshot_take(snapshot *shot, gen_board *board);
+void *render_thread(void *arg);
+/* FRAME EXPORT FUNCTIONS */
+void export_open(frame_export *x, char *image, char *delta);
+void export_frame(frame_export *x, gen_board *board);
+void export_image(frame_export *x);
+void export_delta(frame_export *x);
+void export_close(frame_export *x);
+/* LIFE HELPER FUNCS */
+bool iscopy(gen_board *board1, gen_board *board2);
+void print_board(frame *screen, snapshot *shot);
+void random_fill(gen_board *board);
+void known_fill(gen_board *board);
+void set_known_board(gen_board *board, int config);
+void print_intro(void); 
+int position_r(cell row);
+int position_c(cell col); 
+choice get_choice(void); 
+/* KNOWN CONFIGURATION SETUP FUNCTIONS */
+void set_glider(gen_board *board);
+void set_small_explosion(gen_board *board);
+void set_explosion(gen_board *board);
+void set_ten_cell(gen_board *board);
+void set_light_spaceship(gen_board *board);
+void set_glider_gun(gen_board *board);
+void block(gen_board *board, cell row, cell col);
+void eye(gen_board *board, cell row, cell col);
+void hook(gen_board *board, cell row, cell col);
+void cannon(gen_board *board, cell row, cell col);
+
+dimensions dims;
+strip_kernel_func strip_kernel = strip_kernel_scalar;
+bool bit_popcnt = false;
+unsigned char block_table[BLOCK_TABLE];
+worker_pool *pool = NULL;
+pool_job job;
+bitword *deep_scratch = NULL;
+halo_transport transports[] = {
+   {"shm", halo_shm_open, NULL, halo_shm_exchange,
+    halo_shm_gather, halo_shm_close},
+   {"socket", halo_socket_open, halo_socket_attach, halo_socket_exchange,
+    halo_socket_gather, halo_socket_close}};
+hash_cache cache;
+char *profile_phase_names[] = {"step", "compare", "checkpoint", "render",
+                               "sleep"};
+char *profile_counter_names[] = {"cells_evaluated", "tiles_skipped",
+                                 "bytes_written"};
+sparse_store sparse;
+uint64_t generation = 0;
+run_options options = {false, GENERATIONS, DENSITY, 0, -1, 0, MAX_PERIOD,
+                       NULL, 0, 0, NULL, NULL, 0, NULL, RULE, 1, 0,
+                       HALO_TRANSPORT, NULL, 0, 0, NULL, NULL,
+                       bitpack_engine};
+char *engine_names[] = {"scalar", "bitpack", "simd", "hash", "block",
+                        "sparse"};
+checkpoint_map resumed;
+
+int main(int argc, char *argv[])
+{
+   choice start_state; 
+   int rows = DEFAULT_ROWS, columns = DEFAULT_COLUMNS, threads = 1;
+   int i, args;
+   long long number = 0;
+   bool bench = false, valid;
+   char flag, *value = NULL, *engine = NULL;
+   worker_pool workers;
+
+   /* options come first, each on its own: -n -g 100 ... */
+   options.seed = time(NULL);
+   for (i = 1; i < argc && argv[i][0] == '-'; i++){
+      flag = strlen(argv[i]) == 2 ? argv[i][1] : '?';
+      valid = true;
+      if (strchr("gdskpfxywcirltPTovuajE", flag) != NULL){
+         if (++i == argc){
+            flag = '?';
+         } else {
+            value = argv[i];
+         }
+      }
+      switch (flag){
+      case 'n':
+         options.headless = true;
+         break;
+      case 'b':
+         bench = true;
+         break;
+      case 'g':
+         valid = parse_int(value, &options.generations);
+         break;
+      case 'd':
+         valid = parse_int(value, &options.density);
+         break;
+      case 's':
+         valid = parse_number(value, 0, UINT_MAX, &number);
+         options.seed = (unsigned)number;
+         break;
+      case 'k':
+         valid = parse_int(value, &options.pattern);
+         break;
+      case 'p':
+         valid = parse_int(value, &options.max_period);
+         break;
+      case 'f':
+         options.file = value;
+         break;
+      case 'x':
+         valid = parse_int(value, &options.column);
+         break;
+      case 'y':
+         valid = parse_int(value, &options.row);
+         break;
+      case 'w':
+         options.out = value;
+         break;
+      case 'c':
+         options.checkpoint = value;
+         break;
+      case 'i':
+         valid = parse_int(value, &options.interval);
+         break;
+      case 'r':
+         options.resume = value;
+         break;
+      case 'l':
+         options.rule = value;
+         break;
+      case 't':
+         valid = parse_int(value, &options.depth);
+         break;
+      case 'P':
+         valid = parse_int(value, &options.ranks);
+         break;
+      case 'T':
+         options.transport = value;
+         break;
+      case 'o':
+         options.profile = value;
+         break;
+      case 'v':
+         valid = parse_int(value, &options.frame_rate);
+         break;
+      case 'u':
+         valid = parse_int(value, &options.turbo);
+         break;
+      case 'a':
+         options.image = value;
+         break;
+      case 'j':
+         options.delta = value;
+         break;
+      case 'E':
+         engine = value;
+         break;
+      default:
+         print_usage(argv[0]);
+         return 1;
+      }
+      if (!valid){
+         printf("***ERROR: invalid number %s for -%c***\n", value, flag);
+         return 1;
+      }
+   }
+   args = argc - i;
+   if (args >= 2 && args <= 4){
+      valid = parse_int(argv[i], &rows) && parse_int(argv[i + 1], &columns)
+              && (args < 3 || parse_int(argv[i + 2], &threads));
+      /* strtoull would take -5 as a start of nearly 2^64 */
+      if (args == 4){
+         valid = valid && parse_number(argv[i + 3], 0, LLONG_MAX, &number);
+         options.start = (uint64_t)number;
+      }
+      if (!valid){
+         printf("***ERROR: invalid board size, thread count or start***\n");
+         return 1;
+      }
+   } else if (args != 0){
+      print_usage(argv[0]);
+      return 1;
+   }
+   if (!rule_parse(&rule, options.rule)){
+      printf("***ERROR: invalid rule %s***\n", options.rule);
+      return 1;
+   }
+   if (engine != NULL){
+      for (options.engine = sparse_engine; options.engine >= 0;
+           options.engine--){
+         if (strcmp(engine, engine_names[options.engine]) == 0){
+            break;
+         }
+      }
+      /* a build with -DENGINE=... runs that engine only */
+      if (options.engine < 0 || ENGINE != options.engine){
+         printf("***ERROR: unknown engine %s, or not the one built "
+                "in***\n", engine);
+         return 1;
+      }
+   }
+   /* a checkpoint holds the window only, and the plane goes on past it */
+   if ((ENGINE == hash_engine || ENGINE == sparse_engine)
+       && (options.checkpoint != NULL || options.resume != NULL)){
+      printf("***ERROR: an unbounded plane cannot be checkpointed***\n");
+      return 1;
+   }
+   /* a checkpoint brings its own size, rule, seed and generation */
+   resumed.base = NULL;
+   if (options.resume != NULL){
+      checkpoint_open(&resumed, options.resume);
+      rows = resumed.header->rows;
+      columns = resumed.header->columns;
+      options.seed = (unsigned)resumed.header->seed;
+      rule_compile(&rule, resumed.header->birth, resumed.header->survive);
+   }
+   /* empty space comes alive under B0, so the plane is never empty */
+   if ((ENGINE == hash_engine || ENGINE == sparse_engine)
+       && (rule.birth & 1)){
+      printf("***ERROR: an unbounded plane cannot run B0 rules***\n");
+      return 1;
+   }
+   if (!set_dimensions(rows, columns) || threads < 1){
+      printf("***ERROR: invalid board size or thread count***\n");
+      return 1;
+   }
+   if (options.generations < 0 || options.density < 1
+       || options.pattern < -1 || options.pattern > glider_gun
+       || options.max_period < 0 || options.interval < 0
+       || options.depth < 1){
+      printf("***ERROR: invalid generations, density, pattern, period, "
+             "interval or depth***\n");
+      return 1;
+   }
+   if (options.frame_rate < 0 || options.turbo < 0){
+      printf("***ERROR: invalid frame rate or turbo generations***\n");
+      return 1;
+   }
+   if (options.depth > 1 && ENGINE != bitpack_engine){
+      printf("***ERROR: temporal blocking needs the bit-packed engine***\n");
+      return 1;
+   }
+   /* a run looking for cycles checks every board, so -t would do nothing */
+   if (options.depth > 1 && options.max_period > 0 && !bench){
+      printf("***ERROR: temporal blocking needs -p 0***\n");
+      return 1;
+   }
+   /* ranks step every generation of their own slab and nothing else */
+   if (options.ranks < 0 || (options.ranks > 0
+       && (!options.headless || bench || threads > 1 || options.depth > 1
+           || options.max_period > 0 || options.checkpoint != NULL
+           || ENGINE == hash_engine || ENGINE == sparse_engine))){
+      printf("***ERROR: -P needs -n -p 0, one thread and a board that "
+             "wraps, without -t or -c***\n");
+      return 1;
+   }
+   if ((options.image != NULL || options.delta != NULL)
+       && (!options.headless || bench || options.ranks > 0
+           || (options.image != NULL && options.delta != NULL
+               && strcmp(options.image, "-") == 0
+               && strcmp(options.delta, "-") == 0))){
+      printf("***ERROR: -a and -j write a headless run without -P, "
+             "and only one to -***\n");
+      return 1;
+   }
+   if (options.profile != NULL && (!PROFILE || options.headless || bench)){
+      printf("***ERROR: -o profiles a displayed run of a build with "
+             "-DPROFILE=1***\n");
+      return 1;
+   }
+   select_strip_kernel();
+   select_bit_kernel();
+   if (ENGINE == block_engine){
+      block_init();
+   }
+   if (threads > 1){
+      job_create(&job, threads);
+      pool_create(&workers, threads, pool_work, &job);
+      pool = &workers;
+   } else if (options.depth > 1){
+      deep_scratch = bit_deep_scratch(1);
+   }
+   if (bench){
+      benchmark();
+   } else if (options.headless && options.ranks > 0){
+      domain_run();
+   } else if (options.headless){
+      headless();
+   } else {
+      print_intro();
+
+      /* a pattern file or checkpoint needs no choice of start */
+      start_state = options.file != NULL || resumed.base != NULL
+                    ? known_start : get_choice();
+      life(start_state);
+   }
+   if (pool != NULL){
+      pool_destroy(pool);
+      job_destroy(&job);
+   }
+   free(deep_scratch);
+   checkpoint_close(&resumed);
+   return 0; 
+}
+
+/*****************************************/
+/*     REGULAR VERSION LIFE FUNCTIONS    */
+/*****************************************/
+/* This version of life randomly fills   */
+/* the board and follows standard rules. */
+/* It uses toroidal wrapping. There is   */
+/* an option to fill the board with a    */
+/* known configuration (ie glider gun)   */
+/*****************************************/
+void life (choice start_state)
+{
+   int i = 0, period = 0;
+   arena boards;
+   gen_board boarda, boardb, *latest = &boarda, *next = &boardb;
+   cycle_ring ring;
+   checkpoint saver;
+   frame screen;
+   snapshot_ring shown;
+   frame_pace pace;
+
+   /* both boards are carved out once and swapped every generation */
+   arena_create(&boards, 2 * board_bytes());
+   alloc_board(&boards, &boarda);
+   alloc_board(&boards, &boardb);
+
+   if (resumed.base != NULL){
+      checkpoint_restore(&boarda, &resumed);
+   } else if (options.file != NULL){
+      load_pattern(&boarda, options.file, options.row, options.column);
+   } else if (start_state == random_start){
+      random_fill(&boarda);
+   } else {
+      known_fill(&boarda);
+   }
+   jump_board(&boarda, &boardb, options.start);
+   frame_create(&screen, dims.rows, dims.columns);
+   cycle_create(&ring, options.max_period, &boarda);
+   checkpoint_start(&saver, options.checkpoint, options.interval,
+                    checkpoint_plane_bytes());
+   profile_open(options.profile);
+   render_start(&shown, &screen);
+   pace_start(&pace, options.frame_rate, options.turbo);
+   while (i++ < options.generations && period == 0){
+      if (pace_due(&pace)){
+         profile_enter(phase_render);
+         render_publish(&shown, latest, false);
+         profile_enter(phase_sleep);
+         pace_wait(&pace);
+      }
+
+      profile_enter(phase_step);
+      step_board(latest, next);
+      next = latest;
+      latest = latest == &boarda ? &boardb : &boarda;
+      profile_enter(phase_checkpoint);
+      checkpoint_tick(&saver, latest);
+      profile_enter(phase_compare);
+      period = cycle_check(&ring, latest);
+      profile_generation(latest->stats.generation);
+   }
+   /* waits for the render thread to draw the last board */
+   profile_enter(phase_render);
+   render_stop(&shown, latest);
+   profile_close(latest->stats.generation);
+   if (period != 0){
+      printf("PERIOD: %d\n", period);
+   }
+   if (shown.dropped + shown.passed != 0){
+      printf("FRAMES SKIPPED: %llu\n",
+             (unsigned long long)(shown.dropped + shown.passed));
+   }
+   if (options.out != NULL){
+      save_pattern(latest, options.out);
+   }
+   checkpoint_post(&saver, latest);
+   checkpoint_stop(&saver);
+   cycle_destroy(&ring);
+   frame_destroy(&screen);
+   arena_destroy(&boards);
+   if (ENGINE == hash_engine){
+      hash_destroy();
+   } else if (ENGINE == sparse_engine){
+      sparse_destroy();
+   }
+}
+
+bool iscopy(gen_board *board1, gen_board *board2)
+{
+   /* compares the layout used by ENGINE directly */
+   int r;
+   hnode *root1 = board1->root, *root2 = board2->root;
+   if (ENGINE == hash_engine){
+      /* equal planes are the same node once grown to one size */
+      while (root1->level < root2->level){
+         root1 = hash_expand(root1);
+      }
+      while (root2->level < root1->level){
+         root2 = hash_expand(root2);
+      }
+      return root1 == root2;
+   }
+   if (ENGINE == sparse_engine){
+      return sparse_equal(&board1->plane, &board2->plane);
+   }
+   for (r = 0; r < dims.rows; r++){
+      if (BIT_ENGINE){
+         if (memcmp(BIT_ROW(board1->bits, r), BIT_ROW(board2->bits, r),
+                    dims.row_words * sizeof(bitword))){
+            return false; 
+         }
+      } else if (ENGINE == simd_engine){
+         if (memcmp(STRIP_ROW(board1->strips, r) + 1,
+                    STRIP_ROW(board2->strips, r) + 1, dims.columns)){
+            return false;
+         }
+      } else if (memcmp(&AT(board1->cells, r, 0), &AT(board2->cells, r, 0),
+                        dims.columns * sizeof(cell))){
+         return false;
+      }
+   }
+   return true; 
+}
+
+void random_fill(gen_board *board)
+{
+   /* a bit-packed board is filled by the bands of the pool at once */
+   int i;
+   if (BIT_ENGINE && pool != NULL){
+      pool_fill(pool, board);
+      for (i = 0; i < pool->threads; i++){
+         board->stats.population += job.shares[i].births;
+      }
+   } else {
+      board->stats.population += fill_rows(board, 0, dims.plane_rows);
+   }
+}
+
+cell read_toroidal(cell *board, cell row, cell col)
+{
+  /* wraps around the board Left-Right, Top-Bottom */
+  int r = row % dims.rows;
+  int c = col % dims.columns;
+  if (row < 0){
+     r = dims.rows - 1;
+  }
+  if (col < 0){
+     c = dims.columns - 1;
+  }
+  return AT(board, r, c);
+} 
+
+int sum_cells(cell *board, cell row, cell col)
+{
+   /* counts the total number of live cells */
+   int r, c, sum = 0; 
+   for (r = row-1; r <= row+1; r++){
+      for (c = col-1; c <= col+1; c++){
+         if (read_toroidal(board, r, c)== alive){
+            sum++;
+         }
+      }
+   }   
+   return sum; 
+}
+
+state next_cell_state(int sum, state current_state)
+{
+   /* sum counts the cell itself as well as its neighbours */
+   return rule.next[current_state][sum];
+}
+
+void gen_next_rows(cell *current_board, cell *next_board, int first,
+                   int last)
+{
+   /* next generation for rows first .. last-1 only */
+   int r, c, sum = 0; 
+   for (r = first; r < last; r++){
+      for (c = 0; c < dims.columns; c++){
+         sum = sum_cells(current_board, r, c);
+         AT(next_board, r, c) = next_cell_state(sum,
+                                                AT(current_board, r, c));
+      }
+   }
+}
+
+bool tile_active(tile_flag *changed, int tile_row, int tile_col)
+{
+   /* true if the tile or one of its 8 neighbours (wrapping) changed */
+   int r, c, tr, tc;
+   for (r = tile_row-1; r <= tile_row+1; r++){
+      tr = (r + dims.tile_rows) % dims.tile_rows;
+      for (c = tile_col-1; c <= tile_col+1; c++){
+         tc = (c + dims.tile_columns) % dims.tile_columns;
+         if (changed[tr * dims.tile_columns + tc]){
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+void gen_next_tiles(gen_board *current, gen_board *next, int first,
+                    int last, band_share *share)
+{
+   /* gen_next_rows over the tiles that start in rows first .. last-1. */
+   /* next still holds the generation before current, so a tile whose  */
+   /* surroundings are as they were then comes out as it is already    */
+   /* and is skipped. This covers still lifes and blinkers alike. A    */
+   /* skipped tile undoes the step that made current, so its births    */
+   /* are current's deaths there and its deaths current's births       */
+   int tr, tc, t, r, c, row_end, col_end;
+   bool changed;
+   cell value, old;
+   for (tr = first / TILE_SIZE; tr * TILE_SIZE < last; tr++){
+      row_end = (tr + 1) * TILE_SIZE < dims.rows ? (tr + 1) * TILE_SIZE
+                                                 : dims.rows;
+      for (tc = 0; tc < dims.tile_columns; tc++){
+         t = tr * dims.tile_columns + tc;
+         /* cells set by hand have no real generation before them */
+         changed = current->changed[t] == tile_filled;
+         if (tile_active(current->changed, tr, tc)){
+            col_end = (tc + 1) * TILE_SIZE < dims.columns
+                      ? (tc + 1) * TILE_SIZE : dims.columns;
+            next->census[t].births = next->census[t].deaths = 0;
+            for (r = tr * TILE_SIZE; r < row_end; r++){
+               for (c = tc * TILE_SIZE; c < col_end; c++){
+                  old = AT(current->cells, r, c);
+                  value = next_cell_state(sum_cells(current->cells, r, c),
+                                          old);
+                  if (value != AT(next->cells, r, c)){
+                     changed = true;
+                  }
+                  AT(next->cells, r, c) = value;
+                  next->census[t].births += value > old;
+                  next->census[t].deaths += value < old;
+               }
+            }
+            if (PROFILE){
+               share->evaluated += (int64_t)(row_end - tr * TILE_SIZE)
+                                   * (col_end - tc * TILE_SIZE);
+            }
+         } else {
+            next->census[t].births = current->census[t].deaths;
+            next->census[t].deaths = current->census[t].births;
+            if (PROFILE){
+               share->skipped++;
+            }
+         }
+         share->births += next->census[t].births;
+         share->deaths += next->census[t].deaths;
+         next->changed[t] = changed ? tile_changed : tile_still;
+      }
+   }
+}
+
+void step_board(gen_board *current, gen_board *next)
+{
+   /* advances one generation, on the worker pool if there is one.  */
+   /* next's hash and census are the sums of its bands' shares.     */
+   /* HashLife keeps the population of every node but not the cells */
+   /* that changed, so it has no births or deaths                   */
+   band_share total;
+   int i;
+   generation++;
+   total.hash = 0;
+   total.births = total.deaths = 0;
+   total.evaluated = total.skipped = 0;
+   if (ENGINE == hash_engine){
+      next->root = hash_advance(current->root, 1);
+      total.hash = options.max_period > 0 ? cycle_hash_rows(next, 0, 0)
+                                          : 0;
+   } else if (ENGINE == sparse_engine){
+      sparse_step(&current->plane, &next->plane, &total);
+      total.hash = options.max_period > 0 ? cycle_hash_rows(next, 0, 0)
+                                          : 0;
+   } else if (pool != NULL){
+      pool_run(pool, current, next, 1);
+      for (i = 0; i < pool->threads; i++){
+         total.hash += job.shares[i].hash;
+         total.births += job.shares[i].births;
+         total.deaths += job.shares[i].deaths;
+         if (PROFILE){
+            total.evaluated += job.shares[i].evaluated;
+            total.skipped += job.shares[i].skipped;
+         }
+      }
+   } else {
+      step_rows(current, next, 0, dims.rows, &total);
+   }
+   profile_count(count_evaluated, total.evaluated);
+   profile_count(count_skipped, total.skipped);
+   next->hash = total.hash;
+   next->stats.generation = generation;
+   next->stats.births = total.births;
+   next->stats.deaths = total.deaths;
+   if (ENGINE == hash_engine){
+      next->stats.population = (int64_t)next->root->population;
+   } else {
+      next->stats.population = current->stats.population + total.births
+                               - total.deaths;
+   }
+}
+
+void step_board_deep(gen_board *current, gen_board *next, int depth)
+{
+   /* advances depth generations in one pass over the bit-packed    */
+   /* board, each band of the pool taking its rows through all of   */
+   /* them on its own. next's census is that of the last generation */
+   band_share total;
+   int i;
+   generation += depth;
+   if (pool != NULL){
+      job.depth = depth;
+      pool_run(pool, current, next, 1);
+      job.depth = 1;
+      total.births = total.deaths = total.population = 0;
+      for (i = 0; i < pool->threads; i++){
+         total.births += job.shares[i].births;
+         total.deaths += job.shares[i].deaths;
+         total.population += job.shares[i].population;
+      }
+   } else {
+      bit_deep_rows(current->bits, next->bits, 0, dims.rows, depth,
+                    deep_scratch, &total);
+   }
+   next->hash = options.max_period > 0 ? cycle_hash_rows(next, 0, dims.rows)
+                                       : 0;
+   next->stats.generation = generation;
+   next->stats.births = total.births;
+   next->stats.deaths = total.deaths;
+   next->stats.population = total.population;
+}
+
+void step_rows(gen_board *current, gen_board *next, int first, int last,
+               band_share *share)
+{
+   /* advances rows first .. last-1 with the engine chosen by ENGINE, */
+   /* counting their births and deaths, and hashes them while they    */
+   /* are still in cache when cycles are looked for                   */
+   share->births = share->deaths = 0;
+   if (PROFILE){
+      share->evaluated = ENGINE == scalar_engine
+                         ? 0 : (int64_t)(last - first) * dims.columns;
+      share->skipped = 0;
+   }
+   if (ENGINE == bitpack_engine){
+      bit_gen_next_board(current->bits, next->bits, dims.rows, first, last,
+                         share);
+   } else if (ENGINE == block_engine){
+      block_gen_next_board(current->bits, next->bits, first, last, share);
+   } else if (ENGINE == simd_engine){
+      strip_gen_next_board(current->strips, next->strips, first, last,
+                           share);
+   } else {
+      gen_next_tiles(current, next, first, last, share);
+   }
+   share->hash = options.max_period > 0 ? cycle_hash_rows(next, first, last)
+                                        : 0;
+}
+
+uint64_t jump_board(gen_board *current, gen_board *next,
+                    uint64_t generations)
+{
+   /* leaves the board generations ahead in current. HashLife gets */
+   /* there a power of two at a time, the bit-packed engine -t at  */
+   /* a time and the others a generation at a time. A stop request */
+   /* is seen between them, and the generations taken are returned */
+   gen_board tmp;
+   uint64_t taken = 0, span;
+   int depth, limit, j;
+   if (ENGINE == hash_engine){
+      for (j = 0; (generations >> j) != 0 && !stop_requested; j++){
+         if ((generations >> j) & 1){
+            span = (uint64_t)1 << j;
+            current->root = hash_advance(current->root, span);
+            taken += span;
+         }
+      }
+      generation += taken;
+      current->stats.generation = generation;
+      current->stats.population = (int64_t)current->root->population;
+      current->stats.births = current->stats.deaths = 0;
+      return taken;
+   }
+   limit = options.depth > 1 ? bit_deep_limit() : 1;
+   while (generations > 0 && !stop_requested){
+      depth = generations < (uint64_t)options.depth ? (int)generations
+                                                    : options.depth;
+      depth = depth < limit ? depth : limit;
+      if (depth > 1){
+         step_board_deep(current, next, depth);
+      } else {
+         step_board(current, next);
+      }
+      generations -= depth;
+      taken += depth;
+      tmp = *current;
+      *current = *next;
+      *next = tmp;
+   }
+   return taken;
+}
+
+/*****************************************/
+/*      CYCLE DETECTION FUNCTIONS        */
+/*****************************************/
+/* Every board made by step_board gets a */
+/* 64 bit hash, the sum of one hash per  */
+/* row so that bands can hash their own  */
+/* rows. The cycle log of life_common.c  */
+/* keeps the hashes of the last          */
+/* max_period boards, the first one of   */
+/* the run included, and the ring keeps  */
+/* the board of a hit to compare in full */
+/* with the board p generations on. The  */
+/* HashLife root is canonical and its    */
+/* address stands for the whole plane.   */
+/*****************************************/
+uint64_t cycle_hash_rows(gen_board *board, int first, int last)
+{
+   /* the share of rows first .. last-1 in the layout used by ENGINE */
+   uint64_t h = 0;
+   int r;
+   if (ENGINE == hash_engine){
+      return cycle_mix((uintptr_t)hash_crop(board->root));
+   }
+   if (ENGINE == sparse_engine){
+      return sparse_hash(&board->plane);
+   }
+   for (r = first; r < last; r++){
+      if (BIT_ENGINE){
+         h += cycle_row_hash(BIT_ROW(board->bits, r),
+                             dims.row_words * sizeof(bitword), r);
+      } else if (ENGINE == simd_engine){
+         h += cycle_row_hash(STRIP_ROW(board->strips, r) + 1, dims.columns,
+                             r);
+      } else {
+         h += cycle_row_hash(&AT(board->cells, r, 0),
+                             dims.columns * sizeof(cell), r);
+      }
+   }
+   return h;
+}
+
+void copy_board(gen_board *to, gen_board *from)
+{
+   /* copies the cells, which is all iscopy looks at */
+   if (ENGINE == hash_engine){
+      to->root = from->root;
+   } else if (ENGINE == sparse_engine){
+      sparse_copy(&to->plane, &from->plane);
+   } else if (BIT_ENGINE){
+      memcpy(to->bits, from->bits,
+             (size_t)dims.rows * dims.row_words * sizeof(bitword));
+   } else if (ENGINE == simd_engine){
+      memcpy(to->strips, from->strips, (size_t)dims.rows * dims.strip_width);
+   } else {
+      memcpy(to->cells, from->cells,
+             (size_t)dims.rows * dims.columns * sizeof(cell));
+   }
+   to->hash = from->hash;
+   to->stats = from->stats;
+}
+
+void cycle_create(cycle_ring *ring, int size, gen_board *first)
+{
+   /* size 0 looks for nothing, otherwise first is recorded */
+   cycle_log_create(&ring->log, size);
+   arena_create(&ring->store, size > 0 ? board_bytes() : 0);
+   if (size > 0){
+      alloc_board(&ring->store, &ring->kept);
+   }
+   if (ENGINE == hash_engine && size > 0){
+      /* kept through collections while it is held */
+      ring->kept.root = first->root;
+      cache.keep = &ring->kept;
+      cache.keep_count = 1;
+   }
+   if (size > 0){
+      first->hash = cycle_hash_rows(first, 0, dims.rows);
+      cycle_check(ring, first);
+   }
+}
+
+void cycle_destroy(cycle_ring *ring)
+{
+   cycle_log_destroy(&ring->log);
+   arena_destroy(&ring->store);
+   cache.keep = NULL;
+   cache.keep_count = 0;
+}
+
+int cycle_check(cycle_ring *ring, gen_board *board)
+{
+   /* records board, the latest one made, and returns the period   */
+   /* once a board kept from a hit holds the same cells as board,  */
+   /* otherwise 0. No more hits are taken while one is kept        */
+   if (ring->log.size == 0){
+      return 0;
+   }
+   if (cycle_due(&ring->log) && board->hash == ring->kept.hash
+       && iscopy(board, &ring->kept)){
+      return ring->log.pending;
+   }
+   if (cycle_record(&ring->log, board->hash, generation)){
+      copy_board(&ring->kept, board);
+   }
+   return 0;
+}
+
+/*****************************************/
+/*        RANDOM FILL FUNCTIONS          */
+/*****************************************/
+/* Each row of the board draws whole     */
+/* words from a stream of its own, see   */
+/* life_common.c, so bands of rows fill  */
+/* on their own threads and the board    */
+/* only hangs on the seed.               */
+/*****************************************/
+int64_t fill_rows(gen_board *board, int first, int last)
+{
+   /* brings cells of plane rows first .. last-1 to life at random, */
+   /* those a rank owns when it is one. On a bit-packed board the   */
+   /* words are ored in and the cells that came alive are returned; */
+   /* elsewhere set_cell counts them itself                         */
+   uint64_t key, chance = random_chance(options.density);
+   bitword word, *row;
+   int64_t born = 0;
+   int r, w, c, local;
+   for (r = first; r < last; r++){
+      local = plane_row(r);
+      if (local < 0){
+         continue;
+      }
+      key = random_stream(options.seed, r, 0);
+      for (w = 0; w < dims.row_words; w++){
+         word = random_bits(key, w, chance);
+         if (w == dims.row_words - 1 && dims.last_bits < WORD_BITS){
+            word &= ((bitword)1 << dims.last_bits) - 1;
+         }
+         if (BIT_ENGINE){
+            row = BIT_ROW(board->bits, local);
+            born += bit_count(word & ~row[w], 0);
+            row[w] |= word;
+            continue;
+         }
+         for (c = w * WORD_BITS; word != 0; c++, word >>= 1){
+            if (word & 1){
+               set_cell(board, r, c, alive);
+            }
+         }
+      }
+   }
+   return born;
+}
+
+/*****************************************/
+/*   HEADLESS AND BENCHMARK FUNCTIONS    */
+/*****************************************/
+/* Run the engine with no intro, prompts */
+/* console or delay, and time it. The    */
+/* benchmark steps through a fixed set   */
+/* of sizes, densities and patterns from */
+/* one seed, warms each case up, then    */
+/* times BENCH_REPEATS runs of about     */
+/* BENCH_CELL_UPDATES cell updates.      */
+/*****************************************/
+void print_usage(char *name)
+{
+   printf("usage: %s [-n] [-b] [-g generations] [-d density] [-s seed]\n"
+          "       %*s [-k pattern] [-p period] [-f file [-x column]\n"
+          "       %*s [-y row]] [-w file] [-c file [-i interval]]\n"
+          "       %*s [-r file] [-l rule] [-t depth]\n"
+          "       %*s [-P ranks [-T transport]] [-o file] [-v rate]\n"
+          "       %*s [-u generations] [-a file] [-j file] [-E engine]\n"
+          "       %*s [rows columns [threads [start]]]\n"
+          "  -n  headless: run and time the generations, print a summary\n"
+          "  -b  run the benchmark suite\n"
+          "  -g  generations to run (default %d)\n"
+          "  -d  1 in density cells start alive (default %d)\n"
+          "  -s  seed for the random fill\n"
+          "  -k  known pattern 0-%d for a headless run (default random)\n"
+          "  -p  longest period that ends a run, 0 for none (default %d)\n"
+          "  -f  start from an RLE or Life 1.06 pattern file\n"
+          "  -x  -y  column and row of the pattern's top left (default 0)\n"
+          "  -w  write the last board to a file, Life 1.06 if it ends\n"
+          "      in .lif or .life and RLE otherwise\n"
+          "  -c  write a checkpoint to a file at the end of the run\n"
+          "  -i  and every interval generations as well\n"
+          "  -r  resume from a checkpoint, its size replaces rows columns\n"
+          "  -l  rule as B3/S23 or 23/3 (default %s)\n"
+          "  -t  generations each band of rows takes while in cache,\n"
+          "      with -p 0 (default 1)\n"
+          "  -P  split a headless run over ranks processes by rows\n"
+          "  -T  how they swap edge rows, shm or socket (default %s)\n"
+          "  -o  write phase timings of the displayed run to a file, CSV\n"
+          "      or JSON lines if it ends in .json (PROFILE builds)\n"
+          "  -v  frames a second of a displayed run, each after as many\n"
+          "      generations as fit (default every generation)\n"
+          "  -u  generations to step before the first frame is drawn\n"
+          "  -a  write each generation of a headless run to a file as\n"
+          "      a PGM frame, - for stdout\n"
+          "  -j  and as a delta log of the words that changed\n"
+          "  -E  engine: scalar, bitpack, simd, hash, block or sparse\n"
+          "      (default bitpack)\n",
+          name, (int)strlen(name), "", (int)strlen(name), "",
+          (int)strlen(name), "", (int)strlen(name), "",
+          (int)strlen(name), "", (int)strlen(name), "", GENERATIONS,
+          DENSITY, glider_gun, MAX_PERIOD, RULE, HALO_TRANSPORT);
+}
+
+bool parse_number(char *text, long long low, long long high,
+                  long long *value)
+{
+   /* the whole of text as a number from low to high, unlike atoi */
+   char *end;
+
+   errno = 0;
+   *value = strtoll(text, &end, 10);
+   return end != text && *end == '\0' && errno == 0 && *value >= low
+          && *value <= high;
+}
+
+bool parse_int(char *text, int *value)
+{
+   long long number;
+
+   if (!parse_number(text, INT_MIN, INT_MAX, &number)){
+      return false;
+   }
+   *value = (int)number;
+   return true;
+}
+
+void fill_board(gen_board *board, int pattern)
+{
+   if (pattern < 0){
+      random_fill(board);
+   } else {
+      set_known_board(board, pattern);
+   }
+}
+
+void headless(void)
+{
+   /* runs options.generations with no display and reports the rate. */
+   /* The run stops early once the board is periodic, or on SIGTERM   */
+   /* or SIGINT, and leaves a checkpoint behind either way            */
+   arena boards;
+   gen_board boarda, boardb, tmp;
+   cycle_ring ring;
+   checkpoint saver;
+   frame_export frames;
+   double seconds;
+   int run = 0, period = 0, jump;
+   bool exporting = options.image != NULL || options.delta != NULL;
+
+   arena_create(&boards, 2 * board_bytes());
+   alloc_board(&boards, &boarda);
+   alloc_board(&boards, &boardb);
+   if (resumed.base != NULL){
+      checkpoint_restore(&boarda, &resumed);
+   } else if (options.file != NULL){
+      load_pattern(&boarda, options.file, options.row, options.column);
+   } else {
+      fill_board(&boarda, options.pattern);
+   }
+   jump_board(&boarda, &boardb, options.start);
+   cycle_create(&ring, options.max_period, &boarda);
+   checkpoint_start(&saver, options.checkpoint, options.interval,
+                    checkpoint_plane_bytes());
+   signal(SIGTERM, stop_signal);
+   signal(SIGINT, stop_signal);
+
+   seconds = seconds_now();
+   export_open(&frames, options.image, options.delta);
+   export_frame(&frames, &boarda);
+   while (run < options.generations && period == 0 && !stop_requested){
+      if (options.max_period == 0){
+         /* in one jump, or one per checkpoint or exported frame */
+         jump = exporting ? 1 : options.generations - run;
+         if (saver.interval > 0
+             && jump > saver.interval - (int)(generation % saver.interval)){
+            jump = saver.interval - (int)(generation % saver.interval);
+         }
+         run += (int)jump_board(&boarda, &boardb, jump);
+      } else {
+         step_board(&boarda, &boardb);
+         tmp = boarda;
+         boarda = boardb;
+         boardb = tmp;
+         period = cycle_check(&ring, &boarda);
+         run++;
+      }
+      checkpoint_tick(&saver, &boarda);
+      export_frame(&frames, &boarda);
+   }
+   export_close(&frames);
+   seconds = seconds_now() - seconds;
+
+   printf("life %s %dx%d: %d generations in %.4f s, live cells %lld\n",
+          rule.text, dims.rows, dims.columns, run, seconds,
+          (long long)boarda.stats.population);
+   if (ENGINE != hash_engine){
+      printf("last generation: %lld births, %lld deaths\n",
+             (long long)boarda.stats.births,
+             (long long)boarda.stats.deaths);
+   }
+   if (period != 0){
+      printf("periodic with period %d at generation %llu\n", period,
+             (unsigned long long)ring.log.start);
+   }
+   if (seconds > 0){
+      printf("%.1f generations/s, %.4g cell updates/s\n", run / seconds,
+             (double)run * dims.rows * dims.columns / seconds);
+   }
+   if (stop_requested && run < options.generations){
+      printf("stopped at generation %llu\n", (unsigned long long)generation);
+   }
+   if (options.out != NULL){
+      save_pattern(&boarda, options.out);
+   }
+   checkpoint_post(&saver, &boarda);
+   checkpoint_stop(&saver);
+   cycle_destroy(&ring);
+   arena_destroy(&boards);
+   if (ENGINE == hash_engine){
+      hash_destroy();
+   } else if (ENGINE == sparse_engine){
+      sparse_destroy();
+   }
+}
+
+void benchmark(void)
+{
+   /* the board size given on the command line is benched first */
+   static const int sizes[][2] = {{DEFAULT_ROWS, DEFAULT_COLUMNS},
+                                  {256, 256}, {1024, 1024}};
+   static const int densities[] = {3, DENSITY, 10};
+   static const int patterns[] = {explosion, glider_gun};
+   int rows = dims.rows, columns = dims.columns, density = options.density;
+   int max_period = options.max_period;
+   unsigned seed = options.seed;
+   int s, d, p;
+
+   /* the engines are timed without the board hash */
+   options.max_period = 0;
+   printf("%-12s %-10s %-8s %-11s %12s %10s %12s %12s %12s\n", "mode",
+          "size", "density", "pattern", "gens/s", "+-", "min", "max",
+          "cells/s");
+   for (s = -1; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++){
+      if (s >= 0){
+         if (sizes[s][0] == rows && sizes[s][1] == columns){
+            continue;
+         }
+         set_dimensions(sizes[s][0], sizes[s][1]);
+      }
+      for (d = 0; d < (int)(sizeof(densities) / sizeof(densities[0])); d++){
+         bench_case(dims.rows, dims.columns, densities[d], -1);
+      }
+      for (p = 0; p < (int)(sizeof(patterns) / sizeof(patterns[0])); p++){
+         bench_case(dims.rows, dims.columns, 0, patterns[p]);
+      }
+   }
+   set_dimensions(rows, columns);
+   options.density = density;
+   options.max_period = max_period;
+   options.seed = seed;
+}
+
+void bench_case(int rows, int columns, int density, int pattern)
+{
+   /* one line of the benchmark: warm up, then time the repeats. */
+   /* The spread is the mean absolute deviation of the rate      */
+   static const char *pattern_names[] = {"glider", "small_expl", "explosion",
+                                         "ten_cell", "spaceship",
+                                         "glider_gun"};
+   arena boards;
+   gen_board boarda, boardb;
+   double rate[BENCH_REPEATS], seconds, mean = 0, spread = 0;
+   double low = 0, high = 0;
+   int i, generations;
+   char size[24], ratio[16];
+
+   generations = BENCH_CELL_UPDATES / ((long)rows * columns);
+   if (generations < 8){
+      generations = 8;
+   }
+   options.density = density > 0 ? density : options.density;
+   options.seed = BENCH_SEED;
+   generation = 0;
+   arena_create(&boards, 2 * board_bytes());
+   alloc_board(&boards, &boarda);
+   alloc_board(&boards, &boardb);
+   fill_board(&boarda, pattern);
+   jump_board(&boarda, &boardb, BENCH_WARMUP);
+   for (i = 0; i < BENCH_REPEATS; i++){
+      seconds = seconds_now();
+      jump_board(&boarda, &boardb, generations);
+      seconds = seconds_now() - seconds;
+      rate[i] = generations / (seconds > 0 ? seconds : 1e-9);
+      mean += rate[i] / BENCH_REPEATS;
+      low = i == 0 || rate[i] < low ? rate[i] : low;
+      high = i == 0 || rate[i] > high ? rate[i] : high;
+   }
+   for (i = 0; i < BENCH_REPEATS; i++){
+      spread += (rate[i] > mean ? rate[i] - mean : mean - rate[i])
+                / BENCH_REPEATS;
+   }
+   arena_destroy(&boards);
+   if (ENGINE == hash_engine){
+      hash_destroy();
+   } else if (ENGINE == sparse_engine){
+      sparse_destroy();
+   }
+
+   sprintf(size, "%dx%d", rows, columns);
+   sprintf(ratio, density > 0 ? "1/%d" : "-", density);
+   printf("%-12s %-10s %-8s %-11s %12.1f %10.1f %12.1f %12.1f %12.4g\n",
+          engine_names[ENGINE], size, ratio,
+          pattern < 0 ? "random" : pattern_names[pattern], mean,
+          spread, low, high, mean * rows * columns);
+}
+
+/*****************************************/
+/*        WORKER POOL FUNCTIONS          */
+/*****************************************/
+/* The threads are in life_common.c.     */
+/* Here a job of n generations costs one */
+/* barrier to start and one barrier per  */
+/* generation, after which the bands     */
+/* swap boards. Every row only reads the */
+/* previous board, so the result is      */
+/* identical to the serial step.         */
+/*****************************************/
+void job_create(pool_job *j, int threads)
+{
+   j->fill = NULL;
+   j->depth = 1;
+   j->generations = 0;
+   j->scratch = options.depth > 1 ? bit_deep_scratch(threads) : NULL;
+   j->shares = malloc(threads * sizeof(band_share));
+   if (j->shares == NULL){
+      printf("***ERROR: out of memory for the worker pool***\n");
+      exit(1);
+   }
+}
+
+void job_destroy(pool_job *j)
+{
+   free(j->shares);
+   free(j->scratch);
+   j->shares = NULL;
+   j->scratch = NULL;
+}
+
+void pool_run(worker_pool *p, gen_board *current, gen_board *next,
+              int generations)
+{
+   /* after an even number of generations the result is in current */
+   pool_job *j = p->job;
+   j->current = current;
+   j->next = next;
+   j->generations = generations;
+   pool_post(p);
+}
+
+void pool_fill(worker_pool *p, gen_board *board)
+{
+   /* each band's share holds the cells it brought to life as births */
+   pool_job *j = p->job;
+   j->fill = board;
+   pool_post(p);
+   j->fill = NULL;
+}
+
+void pool_work(worker_pool *p, int index)
+{
+   /* the job is copied out, as the caller may post the next one */
+   /* as soon as it is through the last barrier                   */
+   pool_job *j = p->job;
+   int g, generations = j->generations;
+   int first = (int)((long)dims.rows * index / p->threads);
+   int last = (int)((long)dims.rows * (index + 1) / p->threads);
+   gen_board *current = j->current, *next = j->next, *tmp;
+   if (ENGINE == scalar_engine){
+      /* bands own whole tiles, so each tile flag has one writer */
+      first = (int)((long)dims.tile_rows * index / p->threads) * TILE_SIZE;
+      last = (int)((long)dims.tile_rows * (index + 1) / p->threads)
+             * TILE_SIZE;
+      if (last > dims.rows){
+         last = dims.rows;
+      }
+   }
+   if (j->fill != NULL){
+      j->shares[index].births = fill_rows(j->fill, first, last);
+      pthread_barrier_wait(&p->step);
+      return;
+   }
+   if (j->depth > 1){
+      bit_deep_rows(current->bits, next->bits, first, last, j->depth,
+                    j->scratch + (size_t)index * TEMPORAL_BYTES
+                                 / sizeof(bitword), &j->shares[index]);
+      pthread_barrier_wait(&p->step);
+      return;
+   }
+   for (g = 0; g < generations; g++){
+      step_rows(current, next, first, last, &j->shares[index]);
+      pthread_barrier_wait(&p->step);
+      tmp = current;
+      current = next;
+      next = tmp;
+   }
+}
+
+/*****************************************/
+/*    DOMAIN DECOMPOSITION FUNCTIONS     */
+/*****************************************/
+/* A headless run can be split over -P   */
+/* processes, or ranks, that share no    */
+/* board. Each one's board only holds a  */
+/* slab of rows of its own and the ghost */
+/* rows around it, and only the slab is  */
+/* filled, row by row from the plane, so */
+/* adding ranks lowers what each needs.  */
+/* The slab starts at row pad, the ghost */
+/* rows above end there and those below  */
+/* take the first rows, where the last   */
+/* slab row wraps to. Before each        */
+/* generation a rank sends the rows at   */
+/* its edges to the ranks above and      */
+/* below, the last wrapping round to the */
+/* first, and takes theirs as ghost rows */
+/* either side of the slab, so each row  */
+/* reads what the serial step would. The */
+/* transport that carries the rows is    */
+/* picked by name with -T. At the end    */
+/* the census is gathered on rank 0, and */
+/* the slabs as well only when -w wants  */
+/* the whole board.                      */
+/*****************************************/
+void domain_run(void)
+{
+   /* rank 0 is this process, the others are forked from it once */
+   /* the transport is open, and are waited for at the end        */
+   halo_link link;
+   pid_t pid;
+   int i, status, failed = 0;
+   link.transport = NULL;
+   for (i = 0; i < (int)(sizeof(transports) / sizeof(transports[0])); i++){
+      if (strcmp(options.transport, transports[i].name) == 0){
+         link.transport = &transports[i];
+      }
+   }
+   if (link.transport == NULL){
+      printf("***ERROR: unknown transport %s***\n", options.transport);
+      exit(1);
+   }
+   link.ranks = options.ranks;
+   /* a block row pair reads two rows past its slab, and a cell */
+   /* board keeps its slab on whole tiles                       */
+   link.halo = ENGINE == block_engine ? 2 : 1;
+   link.pad = ENGINE == scalar_engine ? TILE_SIZE : 2 * link.halo;
+   if (BIT_ENGINE){
+      link.row_bytes = dims.row_words * sizeof(bitword);
+   } else if (ENGINE == simd_engine){
+      link.row_bytes = dims.strip_width;
+   } else {
+      link.row_bytes = dims.columns * sizeof(cell);
+   }
+   for (i = 0; i < link.ranks; i++){
+      domain_slab(&link, i, &link.first, &link.last);
+      if (link.last - link.first < link.halo){
+         printf("***ERROR: %d ranks leave a slab thinner than its ghost "
+                "rows***\n", link.ranks);
+         exit(1);
+      }
+   }
+   link.transport->open(&link);
+   fflush(stdout);
+   link.rank = 0;
+   for (i = 1; i < link.ranks; i++){
+      pid = fork();
+      if (pid < 0){
+         printf("***ERROR: could not fork rank %d***\n", i);
+         exit(1);
+      }
+      if (pid == 0){
+         link.rank = i;
+         break;
+      }
+   }
+   domain_slab(&link, link.rank, &link.first, &link.last);
+   if (link.transport->attach != NULL){
+      link.transport->attach(&link);
+   }
+   domain_rank(&link);
+   link.transport->close(&link);
+   if (link.rank != 0){
+      exit(0);
+   }
+   for (i = 1; i < link.ranks; i++){
+      if (wait(&status) < 0 || !WIFEXITED(status)
+          || WEXITSTATUS(status) != 0){
+         failed++;
+      }
+   }
+   if (failed > 0){
+      printf("***ERROR: %d ranks failed***\n", failed);
+      exit(1);
+   }
+}
+
+void domain_rank(halo_link *link)
+{
+   /* fills and runs this rank's slab. Rank 0 reports on the whole */
+   /* board the way headless does                                  */
+   arena boards, whole;
+   gen_board boarda, boardb, board;
+   band_share share;
+   double seconds;
+   int rows = dims.rows;
+
+   set_dimensions(link->pad + link->last - link->first, dims.columns);
+   dims.plane_rows = rows;
+   dims.plane_first = link->first;
+   dims.slab_first = link->pad;
+   arena_create(&boards, 2 * board_bytes());
+   alloc_board(&boards, &boarda);
+   alloc_board(&boards, &boardb);
+   if (resumed.base != NULL){
+      checkpoint_restore(&boarda, &resumed);
+   } else if (options.file != NULL){
+      load_pattern(&boarda, options.file, options.row, options.column);
+   } else {
+      fill_board(&boarda, options.pattern);
+   }
+   share.births = share.deaths = 0;
+   share.population = boarda.stats.population;
+   domain_steps(link, &boarda, &boardb, options.start, &share);
+   seconds = seconds_now();
+   domain_steps(link, &boarda, &boardb, options.generations, &share);
+   seconds = seconds_now() - seconds;
+   if (options.out == NULL){
+      link->transport->gather(link, NULL, &share);
+   } else if (link->rank != 0){
+      link->transport->gather(link, &boarda, &share);
+   } else {
+      /* only a whole board can be written out */
+      set_dimensions(rows, dims.columns);
+      arena_create(&whole, board_bytes());
+      alloc_board(&whole, &board);
+      memcpy(domain_row(&board, 0), domain_row(&boarda, link->pad),
+             (size_t)link->last * link->row_bytes);
+      link->transport->gather(link, &board, &share);
+      board.stats.generation = generation;
+      save_pattern(&board, options.out);
+      arena_destroy(&whole);
+   }
+   if (link->rank == 0){
+      printf("life %s %dx%d: %d generations in %.4f s on %d ranks (%s), "
+             "live cells %lld\n", rule.text, rows, dims.columns,
+             options.generations, seconds, link->ranks,
+             link->transport->name, (long long)share.population);
+      printf("last generation: %lld births, %lld deaths\n",
+             (long long)share.births, (long long)share.deaths);
+      if (seconds > 0){
+         printf("%.1f generations/s, %.4g cell updates/s\n",
+                options.generations / seconds,
+                (double)options.generations * rows * dims.columns
+                / seconds);
+      }
+   }
+   arena_destroy(&boards);
+}
+
+void domain_slab(halo_link *link, int rank, int *first, int *last)
+{
+   /* even shares of the plane rows, or of whole tile rows for the */
+   /* cell engine, which steps every row of a tile it starts       */
+   int tile_rows = (dims.plane_rows + TILE_SIZE - 1) / TILE_SIZE;
+   if (ENGINE == scalar_engine){
+      *first = (int)((long)tile_rows * rank / link->ranks) * TILE_SIZE;
+      *last = (int)((long)tile_rows * (rank + 1) / link->ranks) * TILE_SIZE;
+      if (*last > dims.plane_rows){
+         *last = dims.plane_rows;
+      }
+   } else {
+      *first = (int)((long)dims.plane_rows * rank / link->ranks);
+      *last = (int)((long)dims.plane_rows * (rank + 1) / link->ranks);
+   }
+}
+
+void domain_steps(halo_link *link, gen_board *current, gen_board *next,
+                  uint64_t generations, band_share *share)
+{
+   /* steps the slab with its ghost rows brought up to date first.   */
+   /* share keeps the births and deaths of the last generation and   */
+   /* adds each generation's change in population                   */
+   band_share step;
+   gen_board tmp;
+   while (generations-- > 0){
+      link->transport->exchange(link, current);
+      step_rows(current, next, link->pad, dims.rows, &step);
+      generation++;
+      share->births = step.births;
+      share->deaths = step.deaths;
+      share->population += step.births - step.deaths;
+      tmp = *current;
+      *current = *next;
+      *next = tmp;
+   }
+}
+
+void *domain_row(gen_board *board, int r)
+{
+   if (BIT_ENGINE){
+      return BIT_ROW(board->bits, r);
+   }
+   if (ENGINE == simd_engine){
+      return STRIP_ROW(board->strips, r);
+   }
+   return &AT(board->cells, r, 0);
+}
+
+void domain_ghosts(halo_link *link, gen_board *board, unsigned char *above,
+                   unsigned char *below)
+{
+   /* copies the ghost rows in either side of the slab, those above  */
+   /* up to row pad and those below from row 0. The cell engine      */
+   /* cannot tell whether they changed, so the tile they lie in is   */
+   /* marked as set by hand, which has the tiles of the slab next to */
+   /* it stepped                                                     */
+   size_t edges = (size_t)link->halo * link->row_bytes;
+   memcpy(domain_row(board, link->pad - link->halo), above, edges);
+   memcpy(domain_row(board, 0), below, edges);
+   if (ENGINE == scalar_engine){
+      memset(board->changed, tile_filled, dims.tile_columns);
+   }
+}
+
+void halo_shm_open(halo_link *link)
+{
+   /* one POSIX shared memory object, unlinked as soon as it is    */
+   /* mapped, since the ranks inherit the mapping when they fork.  */
+   /* It holds a process shared barrier, the census of each rank,  */
+   /* two sets of edge slots and, with -w, room to stage the       */
+   /* largest slab                                                 */
+   pthread_barrierattr_t attr;
+   size_t edges = (size_t)link->halo * link->row_bytes, head, census;
+   size_t slab = 0;
+   char name[64];
+   int fd, k, first, last;
+   for (k = 0; k < link->ranks && options.out != NULL; k++){
+      domain_slab(link, k, &first, &last);
+      if ((size_t)(last - first) * link->row_bytes > slab){
+         slab = (size_t)(last - first) * link->row_bytes;
+      }
+   }
+   head = (sizeof(pthread_barrier_t) + CACHE_LINE - 1)
+          / CACHE_LINE * CACHE_LINE;
+   census = (link->ranks * sizeof(band_share) + CACHE_LINE - 1)
+            / CACHE_LINE * CACHE_LINE;
+   link->shared_bytes = head + census + 4 * link->ranks * edges + slab;
+   sprintf(name, "/life-halo-%ld", (long)getpid());
+   fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+   if (fd < 0){
+      printf("***ERROR: could not create shared memory %s***\n", name);
+      exit(1);
+   }
+   if (ftruncate(fd, link->shared_bytes) == 0){
+      link->shared = mmap(NULL, link->shared_bytes,
+                          PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   } else {
+      link->shared = MAP_FAILED;
+   }
+   close(fd);
+   shm_unlink(name);
+   if (link->shared == MAP_FAILED){
+      printf("***ERROR: could not map shared memory %s***\n", name);
+      exit(1);
+   }
+   link->barrier = (pthread_barrier_t *)link->shared;
+   link->shares = (band_share *)(link->shared + head);
+   link->slots = link->shared + head + census;
+   link->staging = link->slots + 4 * link->ranks * edges;
+   link->parity = 0;
+   pthread_barrierattr_init(&attr);
+   pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+   pthread_barrier_init(link->barrier, &attr, link->ranks);
+   pthread_barrierattr_destroy(&attr);
+}
+
+void halo_shm_exchange(halo_link *link, gen_board *board)
+{
+   /* the edges go into this rank's slots and the neighbours' come  */
+   /* out after one barrier. The slots alternate by parity, so a    */
+   /* rank that runs ahead writes the other set while the rest are  */
+   /* still reading this one. The mapping came across the fork, so  */
+   /* shm has no attach                                             */
+   size_t edges = (size_t)link->halo * link->row_bytes;
+   unsigned char *set = link->slots + (size_t)link->parity * link->ranks
+                                      * 2 * edges;
+   unsigned char *mine = set + (size_t)link->rank * 2 * edges;
+   int up = (link->rank + link->ranks - 1) % link->ranks;
+   int down = (link->rank + 1) % link->ranks;
+   memcpy(mine, domain_row(board, link->pad), edges);
+   memcpy(mine + edges, domain_row(board, dims.rows - link->halo), edges);
+   link->parity ^= 1;
+   pthread_barrier_wait(link->barrier);
+   domain_ghosts(link, board, set + ((size_t)up * 2 + 1) * edges,
+                 set + (size_t)down * 2 * edges);
+}
+
+void halo_shm_gather(halo_link *link, gen_board *board, band_share *share)
+{
+   /* share comes back on rank 0 as the whole board's census. With */
+   /* a board, the slabs then pass through staging one rank at a   */
+   /* time, two barriers each, into rank 0's whole board           */
+   int k, first, last;
+   link->shares[link->rank] = *share;
+   pthread_barrier_wait(link->barrier);
+   for (k = 1; k < link->ranks && link->rank == 0; k++){
+      share->births += link->shares[k].births;
+      share->deaths += link->shares[k].deaths;
+      share->population += link->shares[k].population;
+   }
+   for (k = 1; k < link->ranks && board != NULL; k++){
+      domain_slab(link, k, &first, &last);
+      if (link->rank == k){
+         memcpy(link->staging, domain_row(board, link->pad),
+                (size_t)(last - first) * link->row_bytes);
+      }
+      pthread_barrier_wait(link->barrier);
+      if (link->rank == 0){
+         memcpy(domain_row(board, first), link->staging,
+                (size_t)(last - first) * link->row_bytes);
+      }
+      pthread_barrier_wait(link->barrier);
+   }
+}
+
+void halo_shm_close(halo_link *link)
+{
+   munmap(link->shared, link->shared_bytes);
+}
+
+void halo_socket_open(halo_link *link)
+{
+   /* pair k joins rank k, as its down link, to rank k+1 as its up */
+   /* link, which closes the ring. Pair ranks+k reports rank k to  */
+   /* rank 0 at the end                                            */
+   size_t edges = (size_t)link->halo * link->row_bytes;
+   int k;
+   link->fds = malloc(4 * link->ranks * sizeof(int));
+   link->above = malloc(2 * edges);
+   if (link->fds == NULL || link->above == NULL){
+      printf("***ERROR: out of memory for the ghost rows***\n");
+      exit(1);
+   }
+   link->below = link->above + edges;
+   for (k = 0; k < 2 * link->ranks; k++){
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, link->fds + 2 * k) != 0){
+         printf("***ERROR: could not open the rank sockets***\n");
+         exit(1);
+      }
+   }
+}
+
+void halo_socket_attach(halo_link *link)
+{
+   /* keeps this rank's ends and closes the rest. The ring does not */
+   /* block, as halo_socket_exchange moves both edges at once       */
+   int k, n = link->ranks, *fds = link->fds;
+   bool keep;
+   link->down = fds[2 * link->rank];
+   link->up = fds[2 * ((link->rank + n - 1) % n) + 1];
+   link->report = link->rank == 0 ? -1 : fds[2 * (n + link->rank) + 1];
+   for (k = 0; k < 4 * n; k++){
+      keep = fds[k] == link->down || fds[k] == link->up
+             || fds[k] == link->report
+             || (link->rank == 0 && k > 2 * n && k % 2 == 0);
+      if (!keep){
+         close(fds[k]);
+      }
+   }
+   fcntl(link->up, F_SETFL, fcntl(link->up, F_GETFL) | O_NONBLOCK);
+   fcntl(link->down, F_SETFL, fcntl(link->down, F_GETFL) | O_NONBLOCK);
+}
+
+void halo_socket_exchange(halo_link *link, gen_board *board)
+{
+   /* both edges are written and both ghosts read in one poll loop, */
+   /* so two ranks sending rows larger than a socket buffer to each */
+   /* other both get through. The streams keep the generations in   */
+   /* order, so there are no slots to alternate                     */
+   struct pollfd waits[2];
+   unsigned char *out[2], *in[2];
+   size_t edges = (size_t)link->halo * link->row_bytes, sent[2], got[2];
+   ssize_t n;
+   int i, fds[2];
+   fds[0] = link->up;
+   fds[1] = link->down;
+   out[0] = domain_row(board, link->pad);
+   out[1] = domain_row(board, dims.rows - link->halo);
+   in[0] = link->above;
+   in[1] = link->below;
+   sent[0] = sent[1] = got[0] = got[1] = 0;
+   while (sent[0] < edges || sent[1] < edges || got[0] < edges
+          || got[1] < edges){
+      /* a socket that is through is left out, as a neighbour that */
+      /* is through as well may already have hung up                */
+      for (i = 0; i < 2; i++){
+         waits[i].fd = sent[i] < edges || got[i] < edges ? fds[i] : -1;
+         waits[i].events = (sent[i] < edges ? POLLOUT : 0)
+                           | (got[i] < edges ? POLLIN : 0);
+         waits[i].revents = 0;
+      }
+      if (poll(waits, 2, -1) < 0){
+         if (errno == EINTR){
+            continue;
+         }
+         printf("***ERROR: rank %d could not wait on its sockets***\n",
+                link->rank);
+         exit(1);
+      }
+      for (i = 0; i < 2; i++){
+         if (sent[i] < edges && (waits[i].revents & POLLOUT)){
+            n = write(waits[i].fd, out[i] + sent[i], edges - sent[i]);
+            if (n < 0 && errno != EAGAIN && errno != EINTR){
+               printf("***ERROR: rank %d lost a neighbour***\n",
+                      link->rank);
+               exit(1);
+            }
+            sent[i] += n > 0 ? n : 0;
+         }
+         if (got[i] < edges
+             && (waits[i].revents & (POLLIN | POLLHUP | POLLERR))){
+            n = read(waits[i].fd, in[i] + got[i], edges - got[i]);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)){
+               printf("***ERROR: rank %d lost a neighbour***\n",
+                      link->rank);
+               exit(1);
+            }
+            got[i] += n > 0 ? n : 0;
+         }
+      }
+   }
+   domain_ghosts(link, board, link->above, link->below);
+}
+
+void halo_socket_gather(halo_link *link, gen_board *board,
+                        band_share *share)
+{
+   /* each rank sends its census, and its slab if there is a board, */
+   /* to rank 0, which reads them in rank order into its whole      */
+   /* board. share comes back on rank 0 as the whole board's census */
+   band_share theirs;
+   int k, first, last, fd;
+   if (link->rank != 0){
+      halo_socket_move(link->report, share, sizeof(band_share), true);
+      if (board != NULL){
+         halo_socket_move(link->report, domain_row(board, link->pad),
+                          (size_t)(link->last - link->first)
+                          * link->row_bytes, true);
+      }
+      return;
+   }
+   for (k = 1; k < link->ranks; k++){
+      fd = link->fds[2 * (link->ranks + k)];
+      domain_slab(link, k, &first, &last);
+      halo_socket_move(fd, &theirs, sizeof(band_share), false);
+      if (board != NULL){
+         halo_socket_move(fd, domain_row(board, first),
+                          (size_t)(last - first) * link->row_bytes, false);
+      }
+      share->births += theirs.births;
+      share->deaths += theirs.deaths;
+      share->population += theirs.population;
+   }
+}
+
+void halo_socket_close(halo_link *link)
+{
+   int k;
+   close(link->up);
+   close(link->down);
+   if (link->rank == 0){
+      for (k = 1; k < link->ranks; k++){
+         close(link->fds[2 * (link->ranks + k)]);
+      }
+   } else {
+      close(link->report);
+   }
+   free(link->fds);
+   free(link->above);
+}
+
+void halo_socket_move(int fd, void *data, size_t bytes, bool out)
+{
+   /* the whole of data, however many calls it takes */
+   unsigned char *p = data;
+   ssize_t n;
+   while (bytes > 0){
+      n = out ? write(fd, p, bytes) : read(fd, p, bytes);
+      if (n < 0 && errno == EINTR){
+         continue;
+      }
+      if (n <= 0){
+         printf("***ERROR: a rank went away during the gather***\n");
+         exit(1);
+      }
+      p += n;
+      bytes -= n;
+   }
+}
+
+/*****************************************/
+/*       BOARD STORAGE FUNCTIONS         */
+/*****************************************/
+/* The board size is set once at start   */
+/* up. Boards are carved from one arena  */
+/* whose blocks start on a cache line,   */
+/* and the same two boards are reused    */
+/* for every generation. Each engine     */
+/* only allocates its own layout, which  */
+/* is read and written via get_cell and  */
+/* set_cell.                             */
+/*****************************************/
+bool set_dimensions(int rows, int columns)
+{
+   if (rows < 1 || columns < 1){
+      return false;
+   }
+   dims.rows = rows;
+   dims.columns = columns;
+   dims.row_words = (columns + WORD_BITS - 1) / WORD_BITS;
+   dims.last_bits = columns - (dims.row_words - 1) * WORD_BITS;
+   /* one wrap copy either side, plus room for a full vector */
+   /* load past the last column                              */
+   dims.strip_width = (columns + STRIP_LANES - 1) / STRIP_LANES
+                      * STRIP_LANES + STRIP_LANES;
+   dims.tile_rows = (rows + TILE_SIZE - 1) / TILE_SIZE;
+   dims.tile_columns = (columns + TILE_SIZE - 1) / TILE_SIZE;
+   dims.plane_rows = rows;
+   dims.plane_first = dims.slab_first = 0;
+   return true;
+}
+
+size_t board_bytes(void)
+{
+   /* bytes one board needs in the layout used by ENGINE */
+   size_t bytes;
+   if (BIT_ENGINE){
+      bytes = (size_t)dims.rows * dims.row_words * sizeof(bitword);
+   } else if (ENGINE == simd_engine){
+      bytes = (size_t)dims.rows * dims.strip_width;
+   } else if (ENGINE == hash_engine || ENGINE == sparse_engine){
+      bytes = 0;
+   } else {
+      /* the cells, then the tile flags and the tile census, each */
+      /* on their own cache line                                  */
+      bytes = ((size_t)dims.rows * dims.columns * sizeof(cell)
+               + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE
+              + ((size_t)dims.tile_rows * dims.tile_columns
+                 + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE
+              + (size_t)dims.tile_rows * dims.tile_columns
+                * sizeof(tile_census);
+   }
+   return (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+void alloc_board(arena *a, gen_board *board)
+{
+   size_t bytes = board_bytes();
+   void *p = arena_alloc(a, bytes);
+   memset(p, 0, bytes);
+   board->cells = NULL;
+   board->changed = NULL;
+   board->census = NULL;
+   board->bits = NULL;
+   board->strips = NULL;
+   board->root = NULL;
+   board->hash = 0;
+   memset(&board->stats, 0, sizeof(gen_stats));
+   board->stats.generation = generation;
+   if (ENGINE == hash_engine){
+      hash_init();
+      board->root = cache.empty[hash_min_level()];
+   } else if (ENGINE == sparse_engine){
+      sparse_init(&board->plane);
+   } else if (BIT_ENGINE){
+      board->bits = p;
+   } else if (ENGINE == simd_engine){
+      board->strips = p;
+   } else {
+      board->cells = p;
+      board->changed = (tile_flag *)p
+                       + ((size_t)dims.rows * dims.columns * sizeof(cell)
+                          + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+      board->census = (tile_census *)(board->changed
+                                      + ((size_t)dims.tile_rows
+                                         * dims.tile_columns
+                                         + CACHE_LINE - 1)
+                                        / CACHE_LINE * CACHE_LINE);
+      if (rule.birth & 1){
+         /* under B0 an empty tile does not stay empty */
+         memset(board->changed, tile_filled,
+                (size_t)dims.tile_rows * dims.tile_columns);
+      }
+   }
+}
+
+cell get_cell(gen_board *board, int row, int col)
+{
+   int64_t half;
+   if (ENGINE == hash_engine){
+      half = (int64_t)1 << (board->root->level - 1);
+      return hash_get(board->root, row + half, col + half);
+   }
+   if (ENGINE == sparse_engine){
+      return sparse_get(&board->plane, row, col);
+   }
+   if (BIT_ENGINE){
+      return (BIT_ROW(board->bits, row)[col / WORD_BITS]
+              >> (col % WORD_BITS)) & 1;
+   }
+   if (ENGINE == simd_engine){
+      return STRIP_ROW(board->strips, row)[col + 1];
+   }
+   return AT(board->cells, row, col);
+}
+
+void set_cell(gen_board *board, int row, int col, cell value)
+{
+   /* positions past the edge wrap, so known shapes can sit anywhere. */
+   /* row is a plane row, left alone if another rank owns it. The     */
+   /* population follows the cell                                     */
+   bitword bit;
+   strip_cell *strip;
+   int64_t half;
+   row = plane_row(row);
+   if (row < 0){
+      return;
+   }
+   col %= dims.columns;
+   if (ENGINE != hash_engine){
+      board->stats.population += (value == alive)
+                                 - (get_cell(board, row, col) == alive);
+   }
+   if (ENGINE == hash_engine){
+      half = (int64_t)1 << (board->root->level - 1);
+      board->root = hash_set(board->root, row + half, col + half, value);
+      board->stats.population = (int64_t)board->root->population;
+   } else if (ENGINE == sparse_engine){
+      sparse_set(&board->plane, row, col, value);
+   } else if (BIT_ENGINE){
+      bit = (bitword)1 << (col % WORD_BITS);
+      if (value == alive){
+         BIT_ROW(board->bits, row)[col / WORD_BITS] |= bit;
+      } else {
+         BIT_ROW(board->bits, row)[col / WORD_BITS] &= ~bit;
+      }
+   } else if (ENGINE == simd_engine){
+      /* keep the wrap copies at either end of the strip in step */
+      strip = STRIP_ROW(board->strips, row);
+      strip[col + 1] = value;
+      if (col == 0){
+         strip[dims.columns + 1] = value;
+      }
+      if (col == dims.columns - 1){
+         strip[0] = value;
+      }
+   } else {
+      AT(board->cells, row, col) = value;
+      TILE_AT(board->changed, row, col) = tile_filled;
+   }
+}
+
+int plane_row(long row)
+{
+   /* the row of a board holding plane row, wrapped onto the plane, */
+   /* or -1 when this rank does not own it                          */
+   row = (row % dims.plane_rows + dims.plane_rows) % dims.plane_rows;
+   row -= dims.plane_first;
+   if (row < 0 || row >= dims.rows - dims.slab_first){
+      return -1;
+   }
+   return (int)row + dims.slab_first;
+}
+
+/*****************************************/
+/*     BIT-PACKED ENGINE FUNCTIONS       */
+/*****************************************/
+/* Stores 64 cells per word (bit i of    */
+/* word w is column 64*w + i) and counts */
+/* all neighbours of a word at once with */
+/* bitwise full adders. Toroidal wrap is */
+/* done by shifting in the bit from the  */
+/* next word or the far end of the row.  */
+/* Results match gen_next_rows.          */
+/*****************************************/
+static ALWAYS_INLINE bitword bit_west(bitword *row, int w, int row_words,
+                                      int last_bits)
+{
+   /* bit i of the result holds the cell one column to the left */
+   bitword carry;
+   if (w == 0){
+      carry = (row[row_words - 1] >> (last_bits - 1)) & 1;
+   } else {
+      carry = row[w - 1] >> (WORD_BITS - 1);
+   }
+   return (row[w] << 1) | carry;
+}
+
+static ALWAYS_INLINE bitword bit_east(bitword *row, int w, int row_words,
+                                      int last_bits)
+{
+   /* bit i of the result holds the cell one column to the right */
+   /* the last word is kept masked so nothing leaks in from the  */
+   /* unused high bits                                           */
+   if (w == row_words - 1){
+      return (row[w] >> 1) | ((row[0] & 1) << (last_bits - 1));
+   }
+   return (row[w] >> 1) | (row[w + 1] << (WORD_BITS - 1));
+}
+
+static ALWAYS_INLINE bitword bit_next_word(bitword *up, bitword *mid,
+                                           bitword *down, int w,
+                                           int row_words, int last_bits,
+                                           int life)
+{
+   /* adds the 8 neighbour bit-planes with full adders:          */
+   /*    row above and below -> 2 bit sums (a, b)                */
+   /*    left and right      -> 2 bit sum  (m)                   */
+   /* count = ones + 2 * (a1 + b1 + m1 + carry), so a cell has 2 */
+   /* or 3 neighbours exactly when one of those four bits is set */
+   /* life is constant where this is inlined: other rules finish */
+   /* the count and hand it to rule_word                         */
+   bitword uw = bit_west(up, w, row_words, last_bits);
+   bitword ue = bit_east(up, w, row_words, last_bits), u = up[w];
+   bitword dw = bit_west(down, w, row_words, last_bits);
+   bitword de = bit_east(down, w, row_words, last_bits), d = down[w];
+   bitword mw = bit_west(mid, w, row_words, last_bits);
+   bitword me = bit_east(mid, w, row_words, last_bits);
+   bitword a0, a1, b0, b1, m0, m1, ones, carry;
+   bitword x, xc, y, yc, twos, many;
+
+   a0 = uw ^ u ^ ue;
+   a1 = (uw & u) | (ue & (uw ^ u));
+   b0 = dw ^ d ^ de;
+   b1 = (dw & d) | (de & (dw ^ d));
+   m0 = mw ^ me;
+   m1 = mw & me;
+   ones = a0 ^ b0 ^ m0;
+   carry = (a0 & b0) | (m0 & (a0 ^ b0));
+
+   x = a1 ^ b1;
+   xc = a1 & b1;
+   y = m1 ^ carry;
+   yc = m1 & carry;
+   twos = x ^ y;
+   if (!life){
+      /* x & y, xc and yc are never set two at a time but xc and yc */
+      return rule_word(ones, twos, (x & y) ^ xc ^ yc, xc & yc, mid[w]);
+   }
+   many = (x & y) | xc | yc;
+
+   /* born with 3, survives with 2 or 3 */
+   return twos & ~many & (ones | mid[w]);
+}
+
+static ALWAYS_INLINE int bit_count(bitword word, int hw)
+{
+   /* bits set in word. hw is only set in code built for the popcnt */
+   /* instruction, elsewhere they are summed in ever wider fields   */
+   if (hw){
+      return __builtin_popcountll(word);
+   }
+   word -= (word >> 1) & 0x5555555555555555ULL;
+   word = (word & 0x3333333333333333ULL)
+          + ((word >> 2) & 0x3333333333333333ULL);
+   word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+   return (int)((word * 0x0101010101010101ULL) >> 56);
+}
+
+static ALWAYS_INLINE void bit_gen_rows(bitword *current_bits,
+                                       bitword *next_bits, int rows,
+                                       int row_words, int last_bits,
+                                       int first, int last,
+                                       band_share *share, int hw, int life)
+{
+   /* the births and deaths are counted from each word as it is made */
+   int r, w, up, down;
+   bitword *row, *next_row, word;
+   bitword mask = ~(bitword)0 >> (WORD_BITS - last_bits);
+   int64_t births = 0, deaths = 0;
+   for (r = first; r < last; r++){
+      up = (r + rows - 1) % rows;
+      down = (r + 1) % rows;
+      row = current_bits + (size_t)r * row_words;
+      next_row = next_bits + (size_t)r * row_words;
+      for (w = 0; w < row_words; w++){
+         word = bit_next_word(current_bits + (size_t)up * row_words, row,
+                              current_bits + (size_t)down * row_words,
+                              w, row_words, last_bits, life);
+         if (w == row_words - 1){
+            word &= mask;
+         }
+         next_row[w] = word;
+         births += bit_count(word & ~row[w], hw);
+         deaths += bit_count(row[w] & ~word, hw);
+      }
+   }
+   share->births += births;
+   share->deaths += deaths;
+}
+
+static ALWAYS_INLINE void bit_gen_shapes(bitword *current_bits,
+                                         bitword *next_bits, int rows,
+                                         int first, int last,
+                                         band_share *share, int hw)
+{
+   /* the default size and widths that fill whole words get their */
+   /* own copy of the loop with the shape known at compile time,   */
+   /* as does B3/S23. Other rules get one general loop. rows is    */
+   /* where the board wraps, the rows of a temporal block's scratch */
+   if (!rule.life){
+      bit_gen_rows(current_bits, next_bits, rows, dims.row_words,
+                   dims.last_bits, first, last, share, hw, false);
+   } else if (rows == DEFAULT_ROWS && dims.columns == DEFAULT_COLUMNS){
+      bit_gen_rows(current_bits, next_bits, DEFAULT_ROWS,
+                   DEFAULT_ROW_WORDS, DEFAULT_LAST_BITS, first, last,
+                   share, hw, true);
+   } else if (dims.last_bits == WORD_BITS){
+      bit_gen_rows(current_bits, next_bits, rows, dims.row_words,
+                   WORD_BITS, first, last, share, hw, true);
+   } else {
+      bit_gen_rows(current_bits, next_bits, rows, dims.row_words,
+                   dims.last_bits, first, last, share, hw, true);
+   }
+}
+
+void select_bit_kernel(void)
+{
+   /* the census counts bits of every word, so the popcnt */
+   /* instruction is used where CPUID reports it          */
+   bit_popcnt = false;
+#ifdef HAVE_X86_SIMD
+   bit_popcnt = cpu_has_popcnt();
+#endif
+}
+
+void bit_gen_next_board(bitword *current_bits, bitword *next_bits,
+                        int rows, int first, int last, band_share *share)
+{
+#ifdef HAVE_X86_SIMD
+   if (bit_popcnt){
+      bit_gen_popcnt(current_bits, next_bits, rows, first, last, share);
+      return;
+   }
+#endif
+   bit_gen_shapes(current_bits, next_bits, rows, first, last, share, false);
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("popcnt")))
+void bit_gen_popcnt(bitword *current_bits, bitword *next_bits, int rows,
+                    int first, int last, band_share *share)
+{
+   bit_gen_shapes(current_bits, next_bits, rows, first, last, share, true);
+}
+#endif
+
+int bit_deep_limit(void)
+{
+   /* the most generations a block is taken at once. Half the scratch  */
+   /* holds a block and depth rows either side, and depth is kept to a */
+   /* quarter of the rows that fit so the block is at least half of    */
+   /* them. Rows too wide for a depth of 2 are stepped one at a time   */
+   int limit = (int)(TEMPORAL_BYTES / (2 * dims.row_words * sizeof(bitword)))
+               / 4;
+   return limit > 1 ? limit : 1;
+}
+
+bitword *bit_deep_scratch(int bands)
+{
+   /* TEMPORAL_BYTES for each band, whatever the board size, so the */
+   /* benchmark can change it under the same scratch                */
+   bitword *scratch = malloc((size_t)bands * TEMPORAL_BYTES);
+   if (scratch == NULL){
+      printf("***ERROR: out of memory for temporal blocking***\n");
+      exit(1);
+   }
+   return scratch;
+}
+
+void bit_deep_rows(bitword *current_bits, bitword *next_bits, int first,
+                   int last, int depth, bitword *scratch, band_share *share)
+{
+   /* rows first .. last-1 of next, depth generations on from current. */
+   /* A block of them and depth rows either side, wrapping, is copied  */
+   /* into scratch that stays in cache. Each generation loses a row at */
+   /* both edges, so the block is exact after depth of them and only   */
+   /* it is written back. depth is at most bit_deep_limit. The census  */
+   /* is that of the last generation                                   */
+   size_t words = dims.row_words, bytes = words * sizeof(bitword);
+   int block = (int)(TEMPORAL_BYTES / (2 * bytes)) - 2 * depth;
+   int start, end, n, g, r, w;
+   bitword *a, *b, *tmp, *row;
+   band_share spare;
+   share->births = share->deaths = share->population = 0;
+   for (start = first; start < last; start += block){
+      end = start + block < last ? start + block : last;
+      n = end - start + 2 * depth;
+      a = scratch;
+      b = scratch + (size_t)n * words;
+      for (r = 0; r < n; r++){
+         memcpy(a + r * words,
+                BIT_ROW(current_bits,
+                        ((start - depth + r) % dims.rows + dims.rows)
+                        % dims.rows), bytes);
+      }
+      for (g = 1; g <= depth; g++){
+         spare.births = spare.deaths = 0;
+         bit_gen_next_board(a, b, n, g, n - g, g == depth ? share : &spare);
+         tmp = a;
+         a = b;
+         b = tmp;
+      }
+      for (r = start; r < end; r++){
+         row = a + (size_t)(r - start + depth) * words;
+         memcpy(BIT_ROW(next_bits, r), row, bytes);
+         for (w = 0; w < dims.row_words; w++){
+            share->population += bit_count(row[w], false);
+         }
+      }
+   }
+}
+
+/*****************************************/
+/*    BLOCK TABLE ENGINE FUNCTIONS       */
+/*****************************************/
+/* Steps the bit-packed board 2x2 cells  */
+/* at a time. The next state of a 2x2    */
+/* block only depends on the 4x4 square  */
+/* around it, 16 bits, so block_init     */
+/* works out all 65536 of them for the   */
+/* rule once, into a 64KB table that     */
+/* stays in cache. A step is then four   */
+/* shifts and a load per block, with no  */
+/* branch on the cells. Rows and columns */
+/* wrap as in read_toroidal, and the     */
+/* results match gen_next_rows.          */
+/*****************************************/
+void block_init(void)
+{
+   /* bit 4*r + c of an index is cell (r, c) of the 4x4 square, bit */
+   /* 2*r + c of its entry cell (r+1, c+1) one generation on        */
+   int i, k, r, c, dr, dc, sum;
+   for (i = 0; i < BLOCK_TABLE; i++){
+      block_table[i] = 0;
+      for (k = 0; k < 4; k++){
+         r = 1 + k / 2;
+         c = 1 + k % 2;
+         sum = 0;
+         for (dr = -1; dr <= 1; dr++){
+            for (dc = -1; dc <= 1; dc++){
+               sum += (i >> (4 * (r + dr) + c + dc)) & 1;
+            }
+         }
+         block_table[i] |= rule.next[(i >> (4 * r + c)) & 1][sum] << k;
+      }
+   }
+}
+
+static ALWAYS_INLINE unsigned block_nibble(bitword *row, int x)
+{
+   /* columns x .. x+3 of a row as 4 bits, for the blocks that */
+   /* straddle two words or an edge of the board               */
+   unsigned bits = 0;
+   int k, c, s = x % WORD_BITS;
+   if (x >= 0 && x + 4 <= dims.columns){
+      return (unsigned)((row[x / WORD_BITS] >> s)
+                        | (row[x / WORD_BITS + 1] << (WORD_BITS - s))) & 15;
+   }
+   for (k = 0; k < 4; k++){
+      c = (x + k + dims.columns) % dims.columns;
+      bits |= (unsigned)((row[c / WORD_BITS] >> (c % WORD_BITS)) & 1) << k;
+   }
+   return bits;
+}
+
+void block_gen_next_board(bitword *current_bits, bitword *next_bits,
+                          int first, int last, band_share *share)
+{
+   /* rows first .. last-1 two at a time. Each word of the 4 rows   */
+   /* around a pair is shifted west once, so bits c .. c+3 of it    */
+   /* are the columns around a block at c. An odd last row is done  */
+   /* with the row after it, which is not written                   */
+   bitword *rows[4], west[4], *old0, *old1, out0, out1;
+   bitword mask = ~(bitword)0 >> (WORD_BITS - dims.last_bits);
+   unsigned index, result;
+   int r, k, w, c, end, x;
+   for (r = first; r < last; r += 2){
+      for (k = 0; k < 4; k++){
+         rows[k] = BIT_ROW(current_bits, (r + k - 1 + dims.rows) % dims.rows);
+      }
+      old0 = rows[1];
+      old1 = rows[2];
+      for (w = 0; w < dims.row_words; w++){
+         end = w == dims.row_words - 1 ? dims.last_bits : WORD_BITS;
+         for (k = 0; k < 4; k++){
+            west[k] = bit_west(rows[k], w, dims.row_words, dims.last_bits);
+         }
+         out0 = out1 = 0;
+         for (c = 0; c < end; c += 2){
+            if (c + 3 <= end){
+               index = (unsigned)((west[0] >> c) & 15)
+                       | (unsigned)((west[1] >> c) & 15) << 4
+                       | (unsigned)((west[2] >> c) & 15) << 8
+                       | (unsigned)((west[3] >> c) & 15) << 12;
+            } else {
+               x = w * WORD_BITS + c - 1;
+               index = block_nibble(rows[0], x)
+                       | block_nibble(rows[1], x) << 4
+                       | block_nibble(rows[2], x) << 8
+                       | block_nibble(rows[3], x) << 12;
+            }
+            result = block_table[index];
+            out0 |= (bitword)(result & 3) << c;
+            out1 |= (bitword)(result >> 2) << c;
+         }
+         if (w == dims.row_words - 1){
+            out0 &= mask;
+            out1 &= mask;
+         }
+         BIT_ROW(next_bits, r)[w] = out0;
+         share->births += bit_count(out0 & ~old0[w], false);
+         share->deaths += bit_count(old0[w] & ~out0, false);
+         if (r + 1 < last){
+            BIT_ROW(next_bits, r + 1)[w] = out1;
+            share->births += bit_count(out1 & ~old1[w], false);
+            share->deaths += bit_count(old1[w] & ~out1, false);
+         }
+      }
+   }
+}
+
+/*****************************************/
+/*     SIMD STRIP ENGINE FUNCTIONS       */
+/*****************************************/
+/* Keeps one byte per cell in rows that  */
+/* carry a copy of the opposite edge on  */
+/* either side, so a whole row strip can */
+/* be summed with plain vector adds and  */
+/* no modulo. strip[c+1] is column c     */
+/* The kernel is picked once at start up */
+/* from CPUID: AVX2 (32 lanes), SSE2 (16 */
+/* lanes) or the scalar fallback which   */
+/* uses next_cell_state directly, and    */
+/* for B3/S23 or any other rule.         */
+/*****************************************/
+void select_strip_kernel(void)
+{
+   strip_kernel = strip_kernel_scalar;
+#ifdef HAVE_X86_SIMD
+   if (cpu_has_avx2()){
+      strip_kernel = rule.life ? strip_kernel_avx2 : strip_rule_avx2;
+   } else if (cpu_has_sse2()){
+      strip_kernel = rule.life ? strip_kernel_sse2 : strip_rule_sse2;
+   }
+#endif
+}
+
+void strip_gen_next_board(strip_cell *current, strip_cell *next,
+                          int first, int last, band_share *share)
+{
+   /* kernels may write past the last column, so the wrap */
+   /* copies are restored once each row is done           */
+   int r, up, down;
+   strip_cell *next_row;
+   for (r = first; r < last; r++){
+      up = (r + dims.rows - 1) % dims.rows;
+      down = (r + 1) % dims.rows;
+      next_row = STRIP_ROW(next, r);
+      strip_kernel(STRIP_ROW(current, up) + 1, STRIP_ROW(current, r) + 1,
+                   STRIP_ROW(current, down) + 1, next_row + 1);
+      next_row[0] = next_row[dims.columns];
+      next_row[dims.columns + 1] = next_row[1];
+      strip_census(STRIP_ROW(current, r) + 1, next_row + 1, share);
+   }
+}
+
+void strip_census(strip_cell *old, strip_cell *new, band_share *share)
+{
+   /* adds the births and deaths of one row. Cells are 0 or 1, so 8  */
+   /* of them are summed at once by a multiply that gathers the bytes */
+   /* of a word into its top byte                                     */
+   const uint64_t bytes = 0x0101010101010101ULL;
+   uint64_t o, n;
+   int c;
+   for (c = 0; c + 8 <= dims.columns; c += 8){
+      memcpy(&o, old + c, 8);
+      memcpy(&n, new + c, 8);
+      share->births += ((n & ~o) * bytes) >> 56;
+      share->deaths += ((o & ~n) * bytes) >> 56;
+   }
+   for (; c < dims.columns; c++){
+      share->births += new[c] & ~old[c];
+      share->deaths += old[c] & ~new[c];
+   }
+}
+
+void strip_kernel_scalar(strip_cell *up, strip_cell *mid, strip_cell *down,
+                         strip_cell *next)
+{
+   int c, sum;
+   for (c = 0; c < dims.columns; c++){
+      sum = up[c - 1] + up[c] + up[c + 1]
+          + mid[c - 1] + mid[c] + mid[c + 1]
+          + down[c - 1] + down[c] + down[c + 1];
+      next[c] = next_cell_state(sum, mid[c]);
+   }
+}
+
+#ifdef HAVE_X86_SIMD
+int cpu_has_sse2(void)
+{
+   unsigned int a, b, c, d;
+   if (!__get_cpuid(1, &a, &b, &c, &d)){
+      return false;
+   }
+   return (d & bit_SSE2) != 0;
+}
+
+int cpu_has_avx2(void)
+{
+   /* AVX2 needs the cpu flag and the OS saving the ymm registers */
+   unsigned int a, b, c, d, xcr0_lo, xcr0_hi;
+   if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_OSXSAVE)){
+      return false;
+   }
+   __asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+   if ((xcr0_lo & 6) != 6 || __get_cpuid_max(0, 0) < 7){
+      return false;
+   }
+   __cpuid_count(7, 0, a, b, c, d);
+   return (b & bit_AVX2) != 0;
+}
+
+int cpu_has_popcnt(void)
+{
+   unsigned int a, b, c, d;
+   if (!__get_cpuid(1, &a, &b, &c, &d)){
+      return false;
+   }
+   return (c & bit_POPCNT) != 0;
+}
+
+__attribute__((target("sse2")))
+void strip_kernel_sse2(strip_cell *up, strip_cell *mid, strip_cell *down,
+                       strip_cell *next)
+{
+   /* 16 cells per step, sum includes the centre like sum_cells */
+   int c, columns = dims.columns;
+   __m128i sum, cur, three = _mm_set1_epi8(set_alive);
+   __m128i four = _mm_set1_epi8(hold), one = _mm_set1_epi8(alive);
+   for (c = 0; c < columns; c += 16){
+      cur = _mm_loadu_si128((__m128i *)(mid + c));
+      sum = _mm_add_epi8(_mm_loadu_si128((__m128i *)(up + c - 1)),
+                         _mm_loadu_si128((__m128i *)(up + c)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(up + c + 1)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(mid + c - 1)));
+      sum = _mm_add_epi8(sum, cur);
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(mid + c + 1)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(down + c - 1)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(down + c)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(down + c + 1)));
+      /* alive if sum == 3, or sum == 4 and already alive */
+      sum = _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(sum, three), one),
+                         _mm_and_si128(_mm_cmpeq_epi8(sum, four), cur));
+      _mm_storeu_si128((__m128i *)(next + c), sum);
+   }
+}
+
+__attribute__((target("avx2")))
+void strip_kernel_avx2(strip_cell *up, strip_cell *mid, strip_cell *down,
+                       strip_cell *next)
+{
+   /* 32 cells per step, same arithmetic as the SSE2 kernel */
+   int c, columns = dims.columns;
+   __m256i sum, cur, three = _mm256_set1_epi8(set_alive);
+   __m256i four = _mm256_set1_epi8(hold), one = _mm256_set1_epi8(alive);
+   for (c = 0; c < columns; c += 32){
+      cur = _mm256_loadu_si256((__m256i *)(mid + c));
+      sum = _mm256_add_epi8(_mm256_loadu_si256((__m256i *)(up + c - 1)),
+                            _mm256_loadu_si256((__m256i *)(up + c)));
+      sum = _mm256_add_epi8(sum, _mm256_loadu_si256((__m256i *)(up + c + 1)));
+      sum = _mm256_add_epi8(sum, 
+                            _mm256_loadu_si256((__m256i *)(mid + c - 1)));
+      sum = _mm256_add_epi8(sum, cur);
+      sum = _mm256_add_epi8(sum, 
+                            _mm256_loadu_si256((__m256i *)(mid + c + 1)));
+      sum = _mm256_add_epi8(sum, 
+                            _mm256_loadu_si256((__m256i *)(down + c - 1)));
+      sum = _mm256_add_epi8(sum, _mm256_loadu_si256((__m256i *)(down + c)));
+      sum = _mm256_add_epi8(sum, 
+                            _mm256_loadu_si256((__m256i *)(down + c + 1)));
+      sum = _mm256_or_si256(
+               _mm256_and_si256(_mm256_cmpeq_epi8(sum, three), one),
+               _mm256_and_si256(_mm256_cmpeq_epi8(sum, four), cur));
+      _mm256_storeu_si256((__m256i *)(next + c), sum);
+   }
+}
+
+__attribute__((target("sse2")))
+void strip_rule_sse2(strip_cell *up, strip_cell *mid, strip_cell *down,
+                     strip_cell *next)
+{
+   /* any rule: the sums that can give a live cell are matched in */
+   /* turn and each takes the dead or the live entry of the table */
+   int c, s, terms = 0, columns = dims.columns;
+   __m128i sum, cur, out, sums[10], born[10], flip[10];
+   for (s = 0; s < 10; s++){
+      if (rule.next[dead][s] | rule.next[alive][s]){
+         sums[terms] = _mm_set1_epi8(s);
+         born[terms] = _mm_set1_epi8(rule.next[dead][s]);
+         flip[terms++] = _mm_set1_epi8(rule.next[dead][s]
+                                       ^ rule.next[alive][s]);
+      }
+   }
+   for (c = 0; c < columns; c += 16){
+      cur = _mm_loadu_si128((__m128i *)(mid + c));
+      sum = _mm_add_epi8(_mm_loadu_si128((__m128i *)(up + c - 1)),
+                         _mm_loadu_si128((__m128i *)(up + c)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(up + c + 1)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(mid + c - 1)));
+      sum = _mm_add_epi8(sum, cur);
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(mid + c + 1)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(down + c - 1)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(down + c)));
+      sum = _mm_add_epi8(sum, _mm_loadu_si128((__m128i *)(down + c + 1)));
+      out = _mm_setzero_si128();
+      for (s = 0; s < terms; s++){
+         out = _mm_or_si128(out,
+                  _mm_and_si128(_mm_cmpeq_epi8(sum, sums[s]),
+                                _mm_xor_si128(born[s],
+                                              _mm_and_si128(flip[s], cur))));
+      }
+      _mm_storeu_si128((__m128i *)(next + c), out);
+   }
+}
+
+__attribute__((target("avx2")))
+void strip_rule_avx2(strip_cell *up, strip_cell *mid, strip_cell *down,
+                     strip_cell *next)
+{
+   /* 32 cells per step, same table lookup as the SSE2 kernel */
+   int c, s, terms = 0, columns = dims.columns;
+   __m256i sum, cur, out, sums[10], born[10], flip[10];
+   for (s = 0; s < 10; s++){
+      if (rule.next[dead][s] | rule.next[alive][s]){
+         sums[terms] = _mm256_set1_epi8(s);
+         born[terms] = _mm256_set1_epi8(rule.next[dead][s]);
+         flip[terms++] = _mm256_set1_epi8(rule.next[dead][s]
+                                          ^ rule.next[alive][s]);
+      }
+   }
+   for (c = 0; c < columns; c += 32){
+      cur = _mm256_loadu_si256((__m256i *)(mid + c));
+      sum = _mm256_add_epi8(_mm256_loadu_si256((__m256i *)(up + c - 1)),
+                            _mm256_loadu_si256((__m256i *)(up + c)));
+      sum = _mm256_add_epi8(sum, _mm256_loadu_si256((__m256i *)(up + c + 1)));
+      sum = _mm256_add_epi8(sum,
+                            _mm256_loadu_si256((__m256i *)(mid + c - 1)));
+      sum = _mm256_add_epi8(sum, cur);
+      sum = _mm256_add_epi8(sum,
+                            _mm256_loadu_si256((__m256i *)(mid + c + 1)));
+      sum = _mm256_add_epi8(sum,
+                            _mm256_loadu_si256((__m256i *)(down + c - 1)));
+      sum = _mm256_add_epi8(sum, _mm256_loadu_si256((__m256i *)(down + c)));
+      sum = _mm256_add_epi8(sum,
+                            _mm256_loadu_si256((__m256i *)(down + c + 1)));
+      out = _mm256_setzero_si256();
+      for (s = 0; s < terms; s++){
+         out = _mm256_or_si256(out,
+                  _mm256_and_si256(_mm256_cmpeq_epi8(sum, sums[s]),
+                                   _mm256_xor_si256(born[s],
+                                      _mm256_and_si256(flip[s], cur))));
+      }
+      _mm256_storeu_si256((__m256i *)(next + c), out);
+   }
+}
+#endif
+
+/*****************************************/
+/*       HASHLIFE ENGINE FUNCTIONS       */
+/*****************************************/
+/* Holds the plane as a quadtree whose   */
+/* nodes are canonical: equal squares    */
+/* share one node, found via a hash      */
+/* table. A node of level k is 2^k cells */
+/* wide and remembers its centre after   */
+/* 2^(k-2) generations, so a pattern     */
+/* that repeats is only worked out once  */
+/* and a jump of 2^k generations costs   */
+/* about k steps. The root is centred on */
+/* cell (0, 0) of an unbounded plane and */
+/* the board is a window onto it, so     */
+/* this engine does not wrap. Nodes no   */
+/* longer reachable from the board are   */
+/* collected between steps once the      */
+/* cache holds HASH_MAX_NODES. A step    */
+/* that would add more than that many    */
+/* again gives up and is taken as two    */
+/* half steps, so the cache never holds  */
+/* much more than the live plane and     */
+/* HASH_MAX_NODES besides.               */
+/*****************************************/
+static size_t hash_key(hnode *nw, hnode *ne, hnode *sw, hnode *se)
+{
+   uint64_t h = (uintptr_t)nw;
+   h = h * 0x9E3779B97F4A7C15ULL + (uintptr_t)ne;
+   h = h * 0x9E3779B97F4A7C15ULL + (uintptr_t)sw;
+   h = h * 0x9E3779B97F4A7C15ULL + (uintptr_t)se;
+   return (size_t)(h ^ (h >> 29));
+}
+
+void hash_init(void)
+{
+   int k;
+   if (cache.table != NULL){
+      return;
+   }
+   cache.buckets = HASH_BLOCK;
+   cache.limit = (size_t)-1;
+   cache.table = calloc(cache.buckets, sizeof(hnode *));
+   if (cache.table == NULL){
+      printf("***ERROR: out of memory for the node cache***\n");
+      exit(1);
+   }
+   cache.leaf[dead].population = dead;
+   cache.leaf[alive].population = alive;
+   cache.empty[0] = &cache.leaf[dead];
+   for (k = 1; k < HASH_MAX_LEVEL; k++){
+      cache.empty[k] = hash_join(cache.empty[k-1], cache.empty[k-1],
+                                 cache.empty[k-1], cache.empty[k-1]);
+   }
+}
+
+void hash_destroy(void)
+{
+   int i;
+   for (i = 0; i < cache.block_count; i++){
+      free(cache.blocks[i]);
+   }
+   free(cache.blocks);
+   free(cache.table);
+   memset(&cache, 0, sizeof(cache));
+}
+
+hnode *hash_new_node(void)
+{
+   /* nodes come from blocks of HASH_BLOCK, reused via the free list */
+   int i;
+   hnode *block, **blocks, *n;
+   if (cache.free_list == NULL){
+      block = malloc(HASH_BLOCK * sizeof(hnode));
+      blocks = realloc(cache.blocks,
+                       (cache.block_count + 1) * sizeof(hnode *));
+      if (block == NULL || blocks == NULL){
+         printf("***ERROR: out of memory for the node cache***\n");
+         exit(1);
+      }
+      cache.blocks = blocks;
+      cache.blocks[cache.block_count++] = block;
+      for (i = 0; i < HASH_BLOCK; i++){
+         block[i].chain = cache.free_list;
+         cache.free_list = &block[i];
+      }
+   }
+   n = cache.free_list;
+   cache.free_list = n->chain;
+   return n;
+}
+
+void hash_grow(void)
+{
+   /* doubles the table once it holds a node per bucket */
+   size_t i, h, buckets = cache.buckets * 2;
+   hnode **table = calloc(buckets, sizeof(hnode *)), *n, *chain;
+   if (table == NULL){
+      printf("***ERROR: out of memory for the node cache***\n");
+      exit(1);
+   }
+   for (i = 0; i < cache.buckets; i++){
+      for (n = cache.table[i]; n != NULL; n = chain){
+         chain = n->chain;
+         h = hash_key(n->nw, n->ne, n->sw, n->se) & (buckets - 1);
+         n->chain = table[h];
+         table[h] = n;
+      }
+   }
+   free(cache.table);
+   cache.table = table;
+   cache.buckets = buckets;
+}
+
+hnode *hash_join(hnode *nw, hnode *ne, hnode *sw, hnode *se)
+{
+   /* the one node made of these four quadrants */
+   size_t h = hash_key(nw, ne, sw, se) & (cache.buckets - 1);
+   hnode *n;
+   for (n = cache.table[h]; n != NULL; n = n->chain){
+      if (n->nw == nw && n->ne == ne && n->sw == sw && n->se == se){
+         return n;
+      }
+   }
+   n = hash_new_node();
+   n->nw = nw;
+   n->ne = ne;
+   n->sw = sw;
+   n->se = se;
+   n->result = NULL;
+   n->step_result = NULL;
+   n->step_log2 = -1;
+   n->level = nw->level + 1;
+   n->population = nw->population + ne->population + sw->population
+                   + se->population;
+   n->marked = false;
+   n->chain = cache.table[h];
+   cache.table[h] = n;
+   if (++cache.count > cache.buckets){
+      hash_grow();
+   }
+   return n;
+}
+
+int hash_min_level(void)
+{
+   /* smallest root whose south east quarter holds the board */
+   int level = 3;
+   while (((int64_t)1 << (level - 1)) < dims.rows
+          || ((int64_t)1 << (level - 1)) < dims.columns){
+      level++;
+   }
+   return level;
+}
+
+hnode *hash_centre(hnode *n)
+{
+   return hash_join(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+hnode *hash_expand(hnode *n)
+{
+   /* the same pattern in a node twice as wide, still centred */
+   hnode *e;
+   if (n->level + 1 >= HASH_MAX_LEVEL){
+      printf("***ERROR: pattern too large for the node cache***\n");
+      exit(1);
+   }
+   e = cache.empty[n->level - 1];
+   return hash_join(hash_join(e, e, e, n->nw), hash_join(e, e, n->ne, e),
+                    hash_join(e, n->sw, e, e), hash_join(n->se, e, e, e));
+}
+
+hnode *hash_crop(hnode *n)
+{
+   /* the smallest centred node that still covers pattern and board */
+   int min_level = hash_min_level();
+   while (n->level > min_level
+          && hash_centre(n)->population == n->population){
+      n = hash_centre(n);
+   }
+   return n;
+}
+
+cell hash_get(hnode *n, int64_t row, int64_t col)
+{
+   /* row and col are counted from the north west corner of n */
+   int64_t half;
+   while (n->level > 0 && n->population != 0){
+      half = (int64_t)1 << (n->level - 1);
+      if (row < half){
+         n = col < half ? n->nw : n->ne;
+      } else {
+         n = col < half ? n->sw : n->se;
+         row -= half;
+      }
+      if (col >= half){
+         col -= half;
+      }
+   }
+   return n->population != 0 ? alive : dead;
+}
+
+hnode *hash_set(hnode *n, int64_t row, int64_t col, cell value)
+{
+   /* nodes are shared, so the path to the cell is rebuilt */
+   int64_t half;
+   if (n->level == 0){
+      return &cache.leaf[value == alive ? alive : dead];
+   }
+   half = (int64_t)1 << (n->level - 1);
+   if (row < half){
+      if (col < half){
+         return hash_join(hash_set(n->nw, row, col, value), n->ne, n->sw,
+                          n->se);
+      }
+      return hash_join(n->nw, hash_set(n->ne, row, col - half, value),
+                       n->sw, n->se);
+   }
+   if (col < half){
+      return hash_join(n->nw, n->ne, hash_set(n->sw, row - half, col, value),
+                       n->se);
+   }
+   return hash_join(n->nw, n->ne, n->sw,
+                    hash_set(n->se, row - half, col - half, value));
+}
+
+hnode *hash_base(hnode *n)
+{
+   /* a level 2 node: one generation of its centre 2x2, cell by cell */
+   cell grid[4][4];
+   hnode *out[4];
+   int r, c, dr, dc, sum;
+   for (r = 0; r < 4; r++){
+      for (c = 0; c < 4; c++){
+         grid[r][c] = hash_get(n, r, c);
+      }
+   }
+   for (r = 1; r < 3; r++){
+      for (c = 1; c < 3; c++){
+         sum = 0;
+         for (dr = -1; dr <= 1; dr++){
+            for (dc = -1; dc <= 1; dc++){
+               sum += grid[r+dr][c+dc];
+            }
+         }
+         out[(r-1)*2 + c-1] = &cache.leaf[next_cell_state(sum, grid[r][c])];
+      }
+   }
+   return hash_join(out[0], out[1], out[2], out[3]);
+}
+
+hnode *hash_successor(hnode *n, int j)
+{
+   /* the centre of n after 2^j generations, for j <= level - 2, */
+   /* or NULL once the cache has grown past cache.limit          */
+   hnode *c[9], *t[9], *q[4], *result;
+   int i, inner, k = n->level;
+   if (n->population == 0){
+      return cache.empty[k-1];
+   }
+   if (k == 2){
+      if (n->result == NULL){
+         n->result = hash_base(n);
+      }
+      return n->result;
+   }
+   if (j == k - 2 && n->result != NULL){
+      return n->result;
+   }
+   if (j < k - 2 && n->step_result != NULL && n->step_log2 == j){
+      return n->step_result;
+   }
+   if (cache.count > cache.limit){
+      return NULL;
+   }
+   /* nine overlapping squares of half the width, row by row */
+   c[0] = n->nw;
+   c[1] = hash_join(n->nw->ne, n->ne->nw, n->nw->se, n->ne->sw);
+   c[2] = n->ne;
+   c[3] = hash_join(n->nw->sw, n->nw->se, n->sw->nw, n->sw->ne);
+   c[4] = hash_centre(n);
+   c[5] = hash_join(n->ne->sw, n->ne->se, n->se->nw, n->se->ne);
+   c[6] = n->sw;
+   c[7] = hash_join(n->sw->ne, n->se->nw, n->sw->se, n->se->sw);
+   c[8] = n->se;
+   if (j == k - 2){
+      /* two half jumps: each ring of squares advances 2^(k-3) */
+      for (i = 0; i < 9; i++){
+         t[i] = hash_successor(c[i], j - 1);
+         if (t[i] == NULL){
+            return NULL;
+         }
+      }
+      inner = j - 1;
+   } else {
+      for (i = 0; i < 9; i++){
+         t[i] = hash_centre(c[i]);
+      }
+      inner = j;
+   }
+   for (i = 0; i < 4; i++){
+      /* the four quarters of the result, north west first */
+      q[i] = hash_successor(hash_join(t[i + i / 2], t[i + i / 2 + 1],
+                                      t[i + i / 2 + 3], t[i + i / 2 + 4]),
+                            inner);
+      if (q[i] == NULL){
+         return NULL;
+      }
+   }
+   result = hash_join(q[0], q[1], q[2], q[3]);
+   if (j == k - 2){
+      n->result = result;
+   } else {
+      n->step_result = result;
+      n->step_log2 = j;
+   }
+   return result;
+}
+
+hnode *hash_step(hnode *root, int j)
+{
+   /* advances the plane 2^j generations. The root is grown until */
+   /* the pattern sits in its centre half with room to spread     */
+   /* 2^j cells, then grown once more so that its successor       */
+   /* (the centre) is the whole of the next plane                 */
+   while (root->level < j + 2
+          || hash_centre(root)->population != root->population){
+      root = hash_expand(root);
+   }
+   root = hash_successor(hash_expand(root), j);
+   return root != NULL ? hash_crop(root) : NULL;
+}
+
+hnode *hash_advance(hnode *root, uint64_t generations)
+{
+   /* one power of two step per set bit of generations; only the */
+   /* plane being stepped survives a collection                   */
+   int j;
+   for (j = 0; generations != 0; j++, generations >>= 1){
+      if (generations & 1){
+         root = hash_jump(root, j);
+      }
+   }
+   return root;
+}
+
+hnode *hash_jump(hnode *root, int j)
+{
+   /* a step of 2^j that may add HASH_MAX_NODES, or else two of   */
+   /* 2^(j-1). A single generation is always taken whole, as its  */
+   /* nodes only follow the size of the pattern                   */
+   hnode *next;
+   if (cache.count > HASH_MAX_NODES){
+      hash_collect(root);
+   }
+   cache.limit = j > 0 ? cache.count + HASH_MAX_NODES : (size_t)-1;
+   next = hash_step(root, j);
+   if (next == NULL){
+      next = hash_jump(hash_jump(root, j - 1), j - 1);
+   }
+   return next;
+}
+
+void hash_mark(hnode *n)
+{
+   while (!n->marked){
+      n->marked = true;
+      if (n->level == 0){
+         return;
+      }
+      hash_mark(n->nw);
+      hash_mark(n->ne);
+      hash_mark(n->sw);
+      n = n->se;
+   }
+}
+
+void hash_collect(hnode *root)
+{
+   /* mark and sweep: everything not under root, cache.keep or an   */
+   /* empty node is freed, and results that pointed at a freed node */
+   /* are forgotten                                                 */
+   size_t i;
+   int k;
+   hnode **link, *n;
+   hash_mark(root);
+   for (k = 0; k < cache.keep_count; k++){
+      hash_mark(cache.keep[k].root);
+   }
+   for (k = 0; k < HASH_MAX_LEVEL; k++){
+      hash_mark(cache.empty[k]);
+   }
+   hash_mark(&cache.leaf[alive]);
+   for (i = 0; i < cache.buckets; i++){
+      link = &cache.table[i];
+      while ((n = *link) != NULL){
+         if (n->marked){
+            link = &n->chain;
+         } else {
+            *link = n->chain;
+            n->chain = cache.free_list;
+            cache.free_list = n;
+            cache.count--;
+         }
+      }
+   }
+   for (i = 0; i < cache.buckets; i++){
+      for (n = cache.table[i]; n != NULL; n = n->chain){
+         if (n->result != NULL && !n->result->marked){
+            n->result = NULL;
+         }
+         if (n->step_result != NULL && !n->step_result->marked){
+            n->step_result = NULL;
+            n->step_log2 = -1;
+         }
+      }
+   }
+   for (i = 0; i < cache.buckets; i++){
+      for (n = cache.table[i]; n != NULL; n = n->chain){
+         n->marked = false;
+      }
+   }
+   cache.leaf[dead].marked = false;
+   cache.leaf[alive].marked = false;
+}
+
+/*****************************************/
+/*     SPARSE TILE ENGINE FUNCTIONS      */
+/*****************************************/
+/* Keeps an unbounded plane as the tiles */
+/* of SPARSE_TILE x SPARSE_TILE cells    */
+/* that hold a live cell, one bitword a  */
+/* row, in an open addressing table with */
+/* linear probing. A step makes the next */
+/* plane from scratch: each live tile is */
+/* stepped, and so is each missing       */
+/* neighbour whose facing edge is alive, */
+/* the frontier where a tile can appear. */
+/* A tile is stepped like 64 cells of a  */
+/* bit-packed row three words wide, made */
+/* from the 3x3 tiles around it, and is  */
+/* only kept if a cell lives. Emptied    */
+/* tiles go to a free list that gives    */
+/* back what the plane stops using, so   */
+/* memory and time follow the live area. */
+/* Like HashLife, the board is a window  */
+/* onto the plane and does not wrap.     */
+/*****************************************/
+void sparse_init(sparse_map *map)
+{
+   /* registers the map so sparse_destroy can find its tiles */
+   sparse_map **maps;
+   if (sparse.map_count == sparse.map_slots){
+      sparse.map_slots = sparse.map_slots > 0 ? 2 * sparse.map_slots
+                                              : SPARSE_MAPS;
+      maps = realloc(sparse.maps, sparse.map_slots * sizeof(sparse_map *));
+      if (maps == NULL){
+         printf("***ERROR: out of memory for the sparse plane***\n");
+         exit(1);
+      }
+      sparse.maps = maps;
+   }
+   sparse.maps[sparse.map_count++] = map;
+   map->capacity = SPARSE_MIN_SLOTS;
+   map->count = 0;
+   map->slots = calloc(map->capacity, sizeof(sparse_tile *));
+   map->list = malloc(map->capacity / 2 * sizeof(sparse_tile *));
+   if (map->slots == NULL || map->list == NULL){
+      printf("***ERROR: out of memory for the sparse plane***\n");
+      exit(1);
+   }
+}
+
+void sparse_destroy(void)
+{
+   /* frees every map's tiles and tables, and the free list */
+   int i;
+   for (i = 0; i < sparse.map_count; i++){
+      sparse_clear(sparse.maps[i]);
+      free(sparse.maps[i]->slots);
+      free(sparse.maps[i]->list);
+   }
+   sparse_trim(0);
+   free(sparse.maps);
+   memset(&sparse, 0, sizeof(sparse));
+}
+
+size_t sparse_slot(sparse_map *map, int64_t row, int64_t col)
+{
+   /* the slot holding tile (row, col), or the empty one it would take */
+   size_t mask = map->capacity - 1, i;
+   i = (size_t)cycle_mix((uint64_t)row * RANDOM_GAMMA ^ (uint64_t)col)
+       & mask;
+   while (map->slots[i] != NULL
+          && (map->slots[i]->row != row || map->slots[i]->col != col)){
+      i = (i + 1) & mask;
+   }
+   return i;
+}
+
+sparse_tile *sparse_find(sparse_map *map, int64_t row, int64_t col)
+{
+   return map->slots[sparse_slot(map, row, col)];
+}
+
+sparse_tile *sparse_insert(sparse_map *map, int64_t row, int64_t col)
+{
+   /* tile (row, col), added empty if the map does not hold it. The */
+   /* table is kept at most half full                               */
+   sparse_tile *t;
+   size_t i = sparse_slot(map, row, col);
+   if (map->slots[i] != NULL){
+      return map->slots[i];
+   }
+   if (2 * (map->count + 1) > map->capacity){
+      sparse_resize(map, 2 * map->capacity);
+      i = sparse_slot(map, row, col);
+   }
+   if (sparse.free_list != NULL){
+      t = sparse.free_list;
+      sparse.free_list = t->next;
+      sparse.free_count--;
+   } else if ((t = malloc(sizeof(sparse_tile))) == NULL){
+      printf("***ERROR: out of memory for the sparse plane***\n");
+      exit(1);
+   }
+   memset(t, 0, sizeof(sparse_tile));
+   t->row = row;
+   t->col = col;
+   map->slots[i] = t;
+   map->list[map->count++] = t;
+   return t;
+}
+
+void sparse_resize(sparse_map *map, size_t capacity)
+{
+   /* rehashes the tiles held into capacity slots */
+   size_t i;
+   free(map->slots);
+   map->capacity = capacity;
+   map->slots = calloc(capacity, sizeof(sparse_tile *));
+   map->list = realloc(map->list, capacity / 2 * sizeof(sparse_tile *));
+   if (map->slots == NULL || map->list == NULL){
+      printf("***ERROR: out of memory for the sparse plane***\n");
+      exit(1);
+   }
+   for (i = 0; i < map->count; i++){
+      map->slots[sparse_slot(map, map->list[i]->row, map->list[i]->col)]
+         = map->list[i];
+   }
+}
+
+void sparse_clear(sparse_map *map)
+{
+   /* puts every tile on the free list, and shrinks a table far */
+   /* bigger than the plane it held                             */
+   size_t i, count = map->count, capacity = map->capacity;
+   for (i = 0; i < count; i++){
+      map->list[i]->next = sparse.free_list;
+      sparse.free_list = map->list[i];
+      sparse.free_count++;
+   }
+   map->count = 0;
+   while (capacity > SPARSE_MIN_SLOTS && 8 * count < capacity){
+      capacity /= 2;
+   }
+   if (capacity != map->capacity){
+      sparse_resize(map, capacity);
+   } else {
+      memset(map->slots, 0, capacity * sizeof(sparse_tile *));
+   }
+}
 
-/* LIFE PRIMARY FUNCTIONS */
-void life(choice start_state);
-int sum_cells(cell board[][COLUMNS], cell row, cell col);
-state next_cell_state(int sum, state current_state);
-cell read(cell board[][COLUMNS], cell row, cell col); 
-cell read_toroidal(cell board[][COLUMNS], cell row, cell col);
-void gen_next_board(cell current_board[][COLUMNS], 
-                   cell next_board[][COLUMNS]);
-/* LIFE HELPER FUNCS */
-bool iscopy(cell board1[][COLUMNS], cell board2[][COLUMNS]);
-void print_board(cell board[][COLUMNS]);
-void random_fill(cell board[][COLUMNS]);
-void known_fill(cell board[][COLUMNS]); 
-void set_known_board(cell board[][COLUMNS], int config);
-void print_intro(void); 
-void set_color(int color_choice); 
-void clear_console(void);
-int console_width(void);
-int position_r(cell row);
-int position_c(cell col); 
-void position_text(int offset);
-choice get_choice(void); 
-int count_live_cells(cell board[][COLUMNS]);
-/* KNOWN CONFIGURATION SETUP FUNCTIONS */
-void set_glider(cell board[][COLUMNS]);
-void set_small_explosion(cell board[][COLUMNS]);
-void set_explosion(cell board[][COLUMNS]);
-void set_ten_cell(cell board[][COLUMNS]);
-void set_light_spaceship(cell board[][COLUMNS]);
-void set_glider_gun(cell board[][COLUMNS]);
-void block(cell board[][COLUMNS], cell row, cell col);
-void eye(cell board[][COLUMNS], cell row, cell col);
-void hook(cell board[][COLUMNS], cell row, cell col);
-void cannon(cell board[][COLUMNS], cell row, cell col);
-
-int main(void)
+void sparse_trim(size_t keep)
 {
-   choice start_state; 
-   srand(time(NULL));
-   print_intro();
+   /* frees the tiles of the free list beyond keep */
+   sparse_tile *t;
+   while (sparse.free_count > keep){
+      t = sparse.free_list;
+      sparse.free_list = t->next;
+      sparse.free_count--;
+      free(t);
+   }
+}
 
-   start_state = get_choice(); 
-   life(start_state);
-   return 0; 
+cell sparse_get(sparse_map *map, int64_t row, int64_t col)
+{
+   sparse_tile *t = sparse_find(map, SPARSE_TILE_OF(row),
+                                SPARSE_TILE_OF(col));
+   if (t == NULL){
+      return dead;
+   }
+   return (t->bits[row - t->row * SPARSE_TILE]
+           >> (col - t->col * SPARSE_TILE)) & 1;
+}
+
+void sparse_set(sparse_map *map, int64_t row, int64_t col, cell value)
+{
+   /* a tile emptied here stays in the map until the next step */
+   sparse_tile *t;
+   bitword bit, *word;
+   if (value != alive && sparse_get(map, row, col) != alive){
+      return;
+   }
+   t = sparse_insert(map, SPARSE_TILE_OF(row), SPARSE_TILE_OF(col));
+   word = &t->bits[row - t->row * SPARSE_TILE];
+   bit = (bitword)1 << (col - t->col * SPARSE_TILE);
+   if (value == alive && !(*word & bit)){
+      *word |= bit;
+      t->population++;
+   } else if (value != alive && (*word & bit)){
+      *word &= ~bit;
+      t->population--;
+   }
+}
+
+void sparse_step(sparse_map *current, sparse_map *next, band_share *share)
+{
+   /* steps every live tile of current, and the frontier around them, */
+   /* into next                                                        */
+   sparse_tile *t, *n;
+   bitword any, edge;
+   size_t i;
+   int r, dr, dc;
+   sparse_clear(next);
+   for (i = 0; i < current->count; i++){
+      t = current->list[i];
+      if (t->population == 0){
+         continue;
+      }
+      for (any = 0, r = 0; r < SPARSE_TILE; r++){
+         any |= t->bits[r];
+      }
+      for (dr = -1; dr <= 1; dr++){
+         for (dc = -1; dc <= 1; dc++){
+            if (dr != 0 || dc != 0){
+               /* a live neighbour is stepped on its own turn */
+               n = sparse_find(current, t->row + dr, t->col + dc);
+               if (n != NULL && n->population > 0){
+                  continue;
+               }
+               edge = dr < 0 ? t->bits[0]
+                             : dr > 0 ? t->bits[SPARSE_TILE - 1] : any;
+               edge &= dc < 0 ? (bitword)1
+                              : dc > 0 ? (bitword)1 << (WORD_BITS - 1)
+                                       : ~(bitword)0;
+               if (edge == 0
+                   || sparse_find(next, t->row + dr, t->col + dc) != NULL){
+                  continue;
+               }
+            }
+            sparse_tile_step(current, next, t->row + dr, t->col + dc,
+                             share);
+         }
+      }
+   }
+   /* spare tiles for about the next step, the rest are given back */
+   sparse_trim(next->count);
+}
+
+void sparse_tile_step(sparse_map *current, sparse_map *next, int64_t row,
+                      int64_t col, band_share *share)
+{
+   /* tile (row, col) of next from the 3x3 tiles of current around */
+   /* it. Row r+1 of window holds the west, own and east words of   */
+   /* row r, from -1 to SPARSE_TILE, so bit_next_word on its middle */
+   /* word sees the cells either side of the tile. A row with no    */
+   /* live cell within one of it stays dead, as B0 is not allowed   */
+   bitword window[SPARSE_TILE + 2][3], out[SPARSE_TILE], old;
+   bitword rows[SPARSE_TILE + 2];
+   sparse_tile *around[3][3], *t;
+   int r, dr, dc, population = 0;
+   if (PROFILE){
+      share->evaluated += SPARSE_TILE * SPARSE_TILE;
+   }
+   for (dr = 0; dr < 3; dr++){
+      for (dc = 0; dc < 3; dc++){
+         around[dr][dc] = sparse_find(current, row + dr - 1, col + dc - 1);
+      }
+   }
+   for (r = 0; r < SPARSE_TILE + 2; r++){
+      dr = r == 0 ? 0 : r == SPARSE_TILE + 1 ? 2 : 1;
+      for (dc = 0; dc < 3; dc++){
+         t = around[dr][dc];
+         window[r][dc] = t == NULL ? 0
+                                   : t->bits[(r + SPARSE_TILE - 1)
+                                             % SPARSE_TILE];
+      }
+      rows[r] = window[r][0] | window[r][1] | window[r][2];
+   }
+   for (r = 0; r < SPARSE_TILE; r++){
+      if ((rows[r] | rows[r + 1] | rows[r + 2]) == 0){
+         out[r] = 0;
+      } else if (rule.life){
+         out[r] = bit_next_word(window[r], window[r + 1], window[r + 2], 1,
+                                3, WORD_BITS, true);
+      } else {
+         out[r] = bit_next_word(window[r], window[r + 1], window[r + 2], 1,
+                                3, WORD_BITS, false);
+      }
+      old = window[r + 1][1];
+      if (out[r] != 0){
+         population += bit_count(out[r], 0);
+      }
+      if (out[r] != old){
+         share->births += bit_count(out[r] & ~old, 0);
+         share->deaths += bit_count(old & ~out[r], 0);
+      }
+   }
+   if (population > 0){
+      t = sparse_insert(next, row, col);
+      memcpy(t->bits, out, sizeof(out));
+      t->population = population;
+   }
+}
+
+bool sparse_equal(sparse_map *a, sparse_map *b)
+{
+   /* the same live cells, whatever tiles were left empty */
+   sparse_tile *t, *u;
+   size_t i, live_a = 0, live_b = 0;
+   for (i = 0; i < b->count; i++){
+      live_b += b->list[i]->population > 0;
+   }
+   for (i = 0; i < a->count; i++){
+      t = a->list[i];
+      if (t->population == 0){
+         continue;
+      }
+      live_a++;
+      u = sparse_find(b, t->row, t->col);
+      if (u == NULL || memcmp(t->bits, u->bits, sizeof(t->bits)) != 0){
+         return false;
+      }
+   }
+   return live_a == live_b;
+}
+
+void sparse_copy(sparse_map *to, sparse_map *from)
+{
+   sparse_tile *t;
+   size_t i;
+   sparse_clear(to);
+   for (i = 0; i < from->count; i++){
+      if (from->list[i]->population > 0){
+         t = sparse_insert(to, from->list[i]->row, from->list[i]->col);
+         memcpy(t->bits, from->list[i]->bits, sizeof(t->bits));
+         t->population = from->list[i]->population;
+      }
+   }
+}
+
+uint64_t sparse_hash(sparse_map *map)
+{
+   /* a sum over the live tiles, so the order they are held in */
+   /* does not matter                                          */
+   sparse_tile *t;
+   uint64_t h = 0;
+   size_t i;
+   for (i = 0; i < map->count; i++){
+      t = map->list[i];
+      if (t->population > 0){
+         h += cycle_mix(cycle_row_hash(t->bits, sizeof(t->bits), 0)
+                        ^ cycle_mix((uint64_t)t->row * RANDOM_GAMMA
+                                    ^ (uint64_t)t->col));
+      }
+   }
+   return h;
 }
 
 /*****************************************/
-/*     REGULAR VERSION LIFE FUNCTIONS    */
+/*        PATTERN FILE FUNCTIONS         */
 /*****************************************/
-/* This version of life randomly fills   */
-/* the board and follows standard rules. */
-/* It uses toroidal wrapping. There is   */
-/* an option to fill the board with a    */
-/* known configuration (ie glider gun)   */
+/* Reads RLE and Life 1.06 files. The    */
+/* file is mapped, not read, and decoded */
+/* in place with no copy and nothing     */
+/* allocated per cell: each run of live  */
+/* cells goes straight into the board,   */
+/* whole words at a time for the bit-    */
+/* packed engine. Positions wrap like    */
+/* set_cell. An RLE file's rule has to   */
+/* be the rule of the run. The writers   */
+/* emit the same formats from the board  */
+/* window.                               */
 /*****************************************/
-void life (choice start_state)
+void load_pattern(gen_board *board, char *path, int row, int col)
 {
-   int i = 0;
-   cell boarda[ROWS][COLUMNS] = {0};
-   cell boardb[ROWS][COLUMNS] = {0};
-   timespec tim, tim2;
-   tim.tv_sec = 0;
-   tim.tv_nsec = 250000000;
+   struct stat info;
+   char *text;
+   int fd = open(path, O_RDONLY);
+   if (fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)
+       || info.st_size == 0){
+      printf("***ERROR: cannot read pattern file %s***\n", path);
+      exit(1);
+   }
+   text = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (text == MAP_FAILED){
+      printf("***ERROR: cannot map pattern file %s***\n", path);
+      exit(1);
+   }
+   posix_madvise(text, info.st_size, POSIX_MADV_SEQUENTIAL);
+   pattern_parse(board, text, text + info.st_size, row, col);
+   munmap(text, info.st_size);
+}
 
-   if (start_state == random_start){
-      random_fill(boarda); 
+void pattern_parse(gen_board *board, char *p, char *end, int row, int col)
+{
+   /* Life 1.06 opens with its own header line, anything else is */
+   /* taken to be RLE                                            */
+   static char life106[] = "#Life 1.06";
+   size_t length = sizeof(life106) - 1;
+   if ((size_t)(end - p) >= length && memcmp(p, life106, length) == 0){
+      pattern_life106(board, pattern_line(p, end), end, row, col);
    } else {
-      known_fill(boarda); 
-   }
-   while (i++ < GENERATIONS){
-      clear_console();
-      print_board(boarda); 
-      nanosleep(&tim, &tim2);
- 
-      gen_next_board(boarda, boardb);
-      clear_console(); 
-      print_board(boardb);
-      nanosleep(&tim, &tim2);
-
-      gen_next_board(boardb, boarda); 
-      if(iscopy(boarda, boardb)){
-         exit(0);
-      } 
-  }
+      pattern_rle(board, p, end, row, col);
+   }
 }
 
-bool iscopy(cell board1[][COLUMNS], cell board2[][COLUMNS])
+void pattern_rle(gen_board *board, char *p, char *end, int row, int col)
 {
-   cell r, c;
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         if (board1[r][c] != board2[r][c]){
-            return false; 
+   /* comment lines and the "x = m, y = n" header come first, then  */
+   /* runs: a count and b (dead), o (alive) or $ (end of row), up   */
+   /* to !. Other letters are states of multi-state rules and taken */
+   /* as alive. A count is at most the cells of the board           */
+   long count = 0, r = 0, c = 0, run;
+   long limit = (long)dims.plane_rows * dims.columns;
+   bool header = false;
+   char *line;
+   while (p < end && !header){
+      if (*p == '#' || *p == 'x'){
+         header = *p == 'x';
+         line = p;
+         p = pattern_line(p, end);
+         if (header){
+            pattern_rule(line, p, "rule");
          }
+      } else if (isspace((unsigned char)*p)){
+         p++;
+      } else {
+         break;
       }
    }
-   return true; 
+   if (!header){
+      printf("***ERROR: not an RLE or Life 1.06 pattern***\n");
+      exit(1);
+   }
+   for (; p < end && *p != '!'; p++){
+      if (isdigit((unsigned char)*p)){
+         if (count > (limit - (*p - '0')) / 10){
+            printf("***ERROR: RLE run longer than the board***\n");
+            exit(1);
+         }
+         count = count * 10 + (*p - '0');
+         continue;
+      }
+      run = count > 0 ? count : 1;
+      if (*p == 'b' || *p == '.'){
+         c += run;
+      } else if (*p == '$'){
+         r += run;
+         c = 0;
+      } else if (isalpha((unsigned char)*p)){
+         pattern_run(board, row + r, col + c, run);
+         c += run;
+      } else if (!isspace((unsigned char)*p)){
+         printf("***ERROR: bad character '%c' in RLE pattern***\n", *p);
+         exit(1);
+      }
+      count = 0;
+   }
+}
+
+void pattern_life106(gen_board *board, char *p, char *end, int row,
+                     int col)
+{
+   /* one "x y" pair per live cell, relative to the offset, after */
+   /* comment lines and a "#R" line with the rule, if there is one */
+   long x, y;
+   char *line;
+   while (p < end && *p == '#'){
+      line = p;
+      p = pattern_line(p, end);
+      if (p - line > 1 && line[1] == 'R'){
+         pattern_rule(line, p, "#R");
+      }
+   }
+   while (pattern_number(&p, end, &x)){
+      if (!pattern_number(&p, end, &y)){
+         printf("***ERROR: Life 1.06 cell without a row***\n");
+         exit(1);
+      }
+      pattern_run(board, row + y, col + x, 1);
+   }
+   if (p < end){
+      printf("***ERROR: bad character '%c' in Life 1.06 pattern***\n", *p);
+      exit(1);
+   }
+}
+
+void pattern_rule(char *p, char *end, char *key)
+{
+   /* the rule after key on a header line, "rule =" in RLE or "#R"  */
+   /* in Life 1.06, if the line has one, must be the rule of the    */
+   /* run: a pattern saved under B36/S23 means something else under */
+   /* B3/S23                                                        */
+   char text[RULE_TEXT];
+   size_t length = 0, size = strlen(key);
+   life_rule saved;
+   for (; p + size <= end; p++){
+      if (memcmp(p, key, size) == 0){
+         break;
+      }
+   }
+   if (p + size > end){
+      return;
+   }
+   for (p += size; p < end && (isspace((unsigned char)*p)
+                               || *p == '='); p++){
+   }
+   while (p + length < end && length < sizeof(text) - 1
+          && !isspace((unsigned char)p[length]) && p[length] != ','){
+      text[length] = p[length];
+      length++;
+   }
+   text[length] = '\0';
+   if (!rule_parse(&saved, text)){
+      printf("***ERROR: pattern rule %s is not a B/S rule***\n", text);
+      exit(1);
+   }
+   if (saved.birth != rule.birth || saved.survive != rule.survive){
+      printf("***ERROR: pattern rule %s is not the rule of the run %s, "
+             "give it with -l***\n", saved.text, rule.text);
+      exit(1);
+   }
+}
+
+char *pattern_line(char *p, char *end)
+{
+   /* the start of the next line */
+   char *eol = memchr(p, '\n', end - p);
+   return eol != NULL ? eol + 1 : end;
+}
+
+bool pattern_number(char **p, char *end, long *value)
+{
+   /* a signed decimal after any white space, never read past end */
+   char *q = *p;
+   bool negative = false;
+   while (q < end && isspace((unsigned char)*q)){
+      q++;
+   }
+   if (q < end && (*q == '-' || *q == '+')){
+      negative = *q == '-';
+      q++;
+   }
+   if (q == end || !isdigit((unsigned char)*q)){
+      *p = q;
+      return false;
+   }
+   for (*value = 0; q < end && isdigit((unsigned char)*q); q++){
+      *value = *value * 10 + (*q - '0');
+   }
+   if (negative){
+      *value = -*value;
+   }
+   *p = q;
+   return true;
+}
+
+void pattern_run(gen_board *board, long row, long col, long length)
+{
+   /* sets length cells alive from (row, col) along the row, wrapping */
+   int r = plane_row(row);
+   int c = (int)((col % dims.columns + dims.columns) % dims.columns);
+   int n, w, lo, hi;
+   bitword mask, *bits;
+   if (r < 0){
+      return;
+   }
+   if (length > dims.columns){
+      length = dims.columns;
+   }
+   if (!BIT_ENGINE){
+      for (; length > 0; length--){
+         set_cell(board, row, c, alive);
+         c = c + 1 == dims.columns ? 0 : c + 1;
+      }
+      return;
+   }
+   bits = BIT_ROW(board->bits, r);
+   for (; length > 0; length -= n, c = 0){
+      n = length < dims.columns - c ? (int)length : dims.columns - c;
+      for (w = c / WORD_BITS; w <= (c + n - 1) / WORD_BITS; w++){
+         lo = w == c / WORD_BITS ? c % WORD_BITS : 0;
+         hi = w == (c + n - 1) / WORD_BITS ? (c + n - 1) % WORD_BITS
+                                           : WORD_BITS - 1;
+         mask = (~(bitword)0 >> (WORD_BITS - 1 - hi)) & (~(bitword)0 << lo);
+         board->stats.population += bit_count(mask & ~bits[w], false);
+         bits[w] |= mask;
+      }
+   }
+}
+
+void save_pattern(gen_board *board, char *path)
+{
+   /* a name ending in .lif or .life gets Life 1.06, any other RLE */
+   char *dot = strrchr(path, '.');
+   FILE *out = fopen(path, "w");
+   if (out == NULL){
+      printf("***ERROR: cannot write pattern file %s***\n", path);
+      exit(1);
+   }
+   if (dot != NULL && (strcmp(dot, ".lif") == 0
+                       || strcmp(dot, ".life") == 0)){
+      write_life106(board, out);
+   } else {
+      write_rle(board, out);
+   }
+   if (fclose(out) != 0){
+      printf("***ERROR: cannot write pattern file %s***\n", path);
+      exit(1);
+   }
+}
+
+void write_rle(gen_board *board, FILE *out)
+{
+   /* the ends of rows are held back until a live cell follows, so */
+   /* dead runs at the end of a row and empty rows cost nothing    */
+   int r, c, run, ends = 0, width = 0;
+   cell value;
+   fprintf(out, "#C generation %llu\nx = %d, y = %d, rule = %s\n",
+           (unsigned long long)board->stats.generation, dims.columns,
+           dims.rows, rule.text);
+   for (r = 0; r < dims.rows; r++, ends++){
+      for (c = 0; c < dims.columns; c += run){
+         value = get_cell(board, r, c);
+         for (run = 1; c + run < dims.columns
+                       && get_cell(board, r, c + run) == value; run++){
+         }
+         if (value != alive && c + run == dims.columns){
+            break;
+         }
+         if (ends > 0){
+            rle_token(out, ends, '$', &width);
+         }
+         ends = 0;
+         rle_token(out, run, value == alive ? 'o' : 'b', &width);
+      }
+   }
+   fprintf(out, "!\n");
 }
 
-void random_fill(cell board[][COLUMNS])
+void write_life106(gen_board *board, FILE *out)
 {
+   /* the rule goes on a "#R" line, as RLE has it in its header */
    int r, c;
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         if (rand() % DENSITY == 0){
-            board[r][c] = alive; 
+   fprintf(out, "#Life 1.06\n#R %s\n", rule.text);
+   for (r = 0; r < dims.rows; r++){
+      for (c = 0; c < dims.columns; c++){
+         if (get_cell(board, r, c) == alive){
+            fprintf(out, "%d %d\n", c, r);
          }
       }
    }
 }
 
-cell read(cell board[][COLUMNS], cell row, cell col)
+void rle_token(FILE *out, int count, char tag, int *width)
 {
-   /* returns zeros for anything off the board */
-   /* toroidal version below is used instead   */
-   if (row < 0 || row > ROWS-1){
-      return dead;  
+   /* lines are kept to PATTERN_LINE characters, as the format asks */
+   char token[16];
+   int n;
+   if (count > 1){
+      n = sprintf(token, "%d%c", count, tag);
+   } else {
+      n = sprintf(token, "%c", tag);
    }
-   if (col < 0 || col > COLUMNS-1){
-      return dead; 
-   } 
-   return board[row][col];   
+   if (*width + n > PATTERN_LINE){
+      fputc('\n', out);
+      *width = 0;
+   }
+   fputs(token, out);
+   *width += n;
 }
 
-cell read_toroidal(cell board[][COLUMNS], cell row, cell col)
+/*****************************************/
+/*         CHECKPOINT FUNCTIONS          */
+/*****************************************/
+/* A checkpoint is a CHECKPOINT_HEADER   */
+/* byte header and then the live cells   */
+/* as one bit plane in the layout of the */
+/* bit-packed engine, whichever engine   */
+/* wrote it, and life_common.c writes it */
+/* in the background. A run resumes by   */
+/* mapping the file: the bit-packed      */
+/* engine steps from the mapped plane    */
+/* itself, the others set their cells    */
+/* from it. The unbounded engines have   */
+/* live cells outside the window, so     */
+/* they take no checkpoints.             */
+/*****************************************/
+size_t checkpoint_plane_bytes(void)
 {
-  /* wraps around the board Left-Right, Top-Bottom */
-  int r = row % ROWS;
-  int c = col % COLUMNS;
-  if (row < 0){
-     r = ROWS - 1;  
-  }
-  if (col < 0){
-     c = COLUMNS - 1; 
-  }
-  return board[r][c];
-} 
+   return (size_t)dims.rows * dims.row_words * sizeof(bitword);
+}
 
-int sum_cells(cell board[][COLUMNS], cell row, cell col)
+void checkpoint_tick(checkpoint *ck, gen_board *board)
 {
-   /* counts the total number of live cells */
-   int r, c, sum = 0; 
-   for (r = row-1; r <= row+1; r++){
-      for (c = col-1; c <= col+1; c++){
-         if (read_toroidal(board, r, c)== alive){
-            sum++;
+   /* called with each new board, posts every interval generations */
+   if (ck->interval > 0 && board->stats.generation % ck->interval == 0){
+      checkpoint_post(ck, board);
+   }
+}
+
+void checkpoint_post(checkpoint *ck, gen_board *board)
+{
+   /* copies board into the buffer once the writer is done with */
+   /* the last one, and hands it over                          */
+   checkpoint_header *header;
+   bitword *plane;
+   int r, c;
+   if (ck->path == NULL){
+      return;
+   }
+   header = checkpoint_claim(ck);
+   header->mode = CHECKPOINT_LIFE;
+   header->rows = dims.rows;
+   header->columns = dims.columns;
+   header->generation = board->stats.generation;
+   header->seed = options.seed;
+   header->planes = 1;
+   header->row_words = dims.row_words;
+   header->birth = rule.birth;
+   header->survive = rule.survive;
+   plane = (bitword *)(ck->buffer + CHECKPOINT_HEADER);
+   if (BIT_ENGINE){
+      memcpy(plane, board->bits, checkpoint_plane_bytes());
+   } else {
+      memset(plane, 0, checkpoint_plane_bytes());
+      for (r = 0; r < dims.rows; r++){
+         for (c = 0; c < dims.columns; c++){
+            if (get_cell(board, r, c) == alive){
+               BIT_ROW(plane, r)[c / WORD_BITS] |= (bitword)1
+                                                   << (c % WORD_BITS);
+            }
          }
       }
-   }   
-   return sum; 
+   }
+   checkpoint_hand_over(ck);
 }
 
-state next_cell_state(int sum, state current_state)
+void checkpoint_open(checkpoint_map *map, char *path)
+{
+   /* maps the file, which must hold the one plane of a life board */
+   if (!checkpoint_map_file(map, path) || map->header->mode != CHECKPOINT_LIFE
+       || map->header->planes != 1){
+      printf("***ERROR: %s is not a life checkpoint of this version***\n",
+             path);
+      exit(1);
+   }
+}
+
+void checkpoint_restore(gen_board *board, checkpoint_map *map)
+{
+   /* the bit-packed engine takes the mapped plane as its board, */
+   /* a page is only copied once a generation is written to it.  */
+   /* A rank only reads the pages of the rows it owns            */
+   bitword mask = ~(bitword)0 >> (WORD_BITS - dims.last_bits), *row;
+   int r, c, local;
+   generation = map->header->generation;
+   board->stats.generation = generation;
+   if (BIT_ENGINE && dims.slab_first == 0){
+      board->bits = map->planes;
+      board->stats.population = 0;
+      for (r = 0; r < dims.rows; r++){
+         row = BIT_ROW(board->bits, r);
+         if (row[dims.row_words - 1] & ~mask){
+            row[dims.row_words - 1] &= mask;
+         }
+         for (c = 0; c < dims.row_words; c++){
+            board->stats.population += bit_count(row[c], false);
+         }
+      }
+      return;
+   }
+   for (r = 0; r < dims.plane_rows; r++){
+      local = plane_row(r);
+      if (local < 0){
+         continue;
+      }
+      row = BIT_ROW(map->planes, r);
+      if (BIT_ENGINE){
+         memcpy(BIT_ROW(board->bits, local), row,
+                dims.row_words * sizeof(bitword));
+         row = BIT_ROW(board->bits, local);
+         row[dims.row_words - 1] &= mask;
+         for (c = 0; c < dims.row_words; c++){
+            board->stats.population += bit_count(row[c], false);
+         }
+         continue;
+      }
+      for (c = 0; c < dims.columns; c++){
+         if ((row[c / WORD_BITS] >> (c % WORD_BITS)) & 1){
+            set_cell(board, r, c, alive);
+         }
+      }
+   }
+}
+
+/*****************************************/
+/*        RENDER THREAD FUNCTIONS        */
+/*****************************************/
+/* A displayed run draws on a thread of  */
+/* its own. The run copies the boards it */
+/* shows into snapshots, one bit a       */
+/* square, in a ring of SNAPSHOT_SLOTS   */
+/* with one writer and one reader. The   */
+/* run moves head once a slot is full,   */
+/* the render thread moves tail once it  */
+/* is done with one, and neither waits   */
+/* on a lock. The render thread draws    */
+/* the newest snapshot and passes over   */
+/* the older ones. When it falls so far  */
+/* behind that the ring is full, the run */
+/* drops the board instead of waiting,   */
+/* so a slow terminal never holds the    */
+/* generations back.                     */
+/*****************************************/
+void render_start(snapshot_ring *r, frame *screen)
 {
-   if (sum == set_alive) {
-      return alive;
+   size_t words = (size_t)dims.rows * dims.row_words;
+   int i;
+   r->screen = screen;
+   r->head = r->tail = 0;
+   r->done = false;
+   r->dropped = r->passed = 0;
+   for (i = 0; i < SNAPSHOT_SLOTS; i++){
+      r->slots[i].cells = malloc(words * sizeof(bitword));
+      if (r->slots[i].cells == NULL){
+         printf("***ERROR: out of memory for the snapshots***\n");
+         exit(1);
+      }
    }
-   if (sum == hold) {
-      return current_state;
+   if (pthread_create(&r->thread, NULL, render_thread, r) != 0){
+      printf("***ERROR: could not start the render thread***\n");
+      exit(1);
    }
-   return dead; 
 }
 
-void gen_next_board(cell current_board[][COLUMNS], 
-                   cell next_board[][COLUMNS])
+void render_stop(snapshot_ring *r, gen_board *board)
 {
-   int r, c, sum = 0; 
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         sum = sum_cells(current_board, r, c);
-         next_board[r][c] = next_cell_state(sum, current_board[r][c]); 
+   /* the last board is always shown, so this one waits for a slot */
+   int i;
+   render_publish(r, board, true);
+   ATOMIC_STORE(&r->done, true);
+   pthread_join(r->thread, NULL);
+   for (i = 0; i < SNAPSHOT_SLOTS; i++){
+      free(r->slots[i].cells);
+   }
+}
+
+void render_publish(snapshot_ring *r, gen_board *board, bool wait)
+{
+   /* copies board into the slot at head and hands it over. Only */
+   /* the run writes head, so it reads its own copy plainly      */
+   timespec poll;
+   uint64_t head = r->head;
+   poll.tv_sec = 0;
+   poll.tv_nsec = RENDER_POLL_NS;
+   while (head - ATOMIC_LOAD(&r->tail) == SNAPSHOT_SLOTS){
+      if (!wait){
+         r->dropped++;
+         return;
       }
+      nanosleep(&poll, NULL);
    }
+   snapshot_take(&r->slots[head % SNAPSHOT_SLOTS], board);
+   ATOMIC_STORE(&r->head, head + 1);
 }
 
-void print_board(cell board[][COLUMNS])
+void snapshot_take(snapshot *shot, gen_board *board)
 {
+   /* a bit-packed board is its own snapshot, the others are read */
+   /* a cell at a time                                            */
    int r, c;
-   static int cnt = 0; 
-   char cell_block = '#'; 
-   printf("\n");
-   position_text(COLUMNS/2);
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         if (board[r][c] == alive){
-            set_color(yellow);
-         } else {
-            set_color(mild_blue);
+   bitword *row;
+   shot->population = board->stats.population;
+   shot->generation = board->stats.generation;
+   if (BIT_ENGINE){
+      memcpy(shot->cells, board->bits,
+             (size_t)dims.rows * dims.row_words * sizeof(bitword));
+      return;
+   }
+   for (r = 0; r < dims.rows; r++){
+      row = BIT_ROW(shot->cells, r);
+      memset(row, 0, dims.row_words * sizeof(bitword));
+      for (c = 0; c < dims.columns; c++){
+         if (get_cell(board, r, c) == alive){
+            row[c / WORD_BITS] |= (bitword)1 << (c % WORD_BITS);
          }
-         printf("%c", cell_block);
-         if (c == COLUMNS - 1){
-            printf("\n");
-            position_text(COLUMNS/2);
+      }
+   }
+}
+
+void *render_thread(void *arg)
+{
+   /* done is read ahead of head, so the last snapshot, published */
+   /* before done is set, is drawn before the thread ends         */
+   snapshot_ring *r = arg;
+   timespec poll;
+   uint64_t head, tail = 0;
+   bool done;
+   poll.tv_sec = 0;
+   poll.tv_nsec = RENDER_POLL_NS;
+   while (true){
+      done = ATOMIC_LOAD(&r->done);
+      head = ATOMIC_LOAD(&r->head);
+      if (head != tail){
+         print_board(r->screen, &r->slots[(head - 1) % SNAPSHOT_SLOTS]);
+         r->passed += head - tail - 1;
+         tail = head;
+         ATOMIC_STORE(&r->tail, tail);
+      } else if (done){
+         break;
+      } else {
+         nanosleep(&poll, NULL);
+      }
+   }
+   return NULL;
+}
+
+/*****************************************/
+/*        FRAME EXPORT FUNCTIONS         */
+/*****************************************/
+/* A headless run can write every        */
+/* generation as it steps. -a gives a    */
+/* stream of binary PGM frames, one byte */
+/* a square, that an encoder can read    */
+/* from a pipe. Each byte of a board row */
+/* becomes 8 pixels through a table, so  */
+/* no square is formatted on its own. -j */
+/* gives the delta log of life_common.c, */
+/* with the one plane of live cells.     */
+/* The first generation is XORed with an */
+/* empty board. Either can be - for      */
+/* stdout, and the summary goes to       */
+/* stderr instead.                       */
+/*****************************************/
+void export_open(frame_export *x, char *image, char *delta)
+{
+   size_t words = (size_t)dims.rows * dims.row_words;
+   int b, i;
+   x->image = image != NULL ? export_file(image) : NULL;
+   x->delta = delta != NULL ? export_file(delta) : NULL;
+   if (x->image == NULL && x->delta == NULL){
+      return;
+   }
+   x->shot.cells = malloc(words * sizeof(bitword));
+   x->shown = calloc(words, sizeof(bitword));
+   x->pixels = malloc((size_t)dims.row_words * WORD_BITS);
+   if (x->shot.cells == NULL || x->shown == NULL || x->pixels == NULL){
+      printf("***ERROR: out of memory for the frames***\n");
+      exit(1);
+   }
+   for (b = 0; b < 256; b++){
+      for (i = 0; i < 8; i++){
+         x->bytes[b][i] = (b >> i) & 1 ? 255 : 0;
+      }
+   }
+   if (x->delta != NULL){
+      export_header(x->delta, 1, dims.rows, dims.columns, dims.row_words);
+   }
+}
+
+void export_frame(frame_export *x, gen_board *board)
+{
+   if (x->image == NULL && x->delta == NULL){
+      return;
+   }
+   snapshot_take(&x->shot, board);
+   if (x->image != NULL){
+      export_image(x);
+   }
+   if (x->delta != NULL){
+      export_delta(x);
+   }
+}
+
+void export_image(frame_export *x)
+{
+   int r, w, k;
+   bitword *row;
+   fprintf(x->image, "P5\n%d %d\n255\n", dims.columns, dims.rows);
+   for (r = 0; r < dims.rows; r++){
+      row = BIT_ROW(x->shot.cells, r);
+      for (w = 0; w < dims.row_words; w++){
+         for (k = 0; k < WORD_BITS / 8; k++){
+            memcpy(x->pixels + w * WORD_BITS + 8 * k,
+                   x->bytes[(row[w] >> (8 * k)) & 0xff], 8);
          }
       }
+      fwrite(x->pixels, 1, dims.columns, x->image);
    }
-   set_color(normal);
-   printf("\nLIVE CELLS: %d\n", count_live_cells(board)); 
-   printf("GENERATION: %d\n", cnt++);
 }
 
-void position_text(int offset)
+void export_delta(frame_export *x)
+{
+   /* shown is left holding this generation, for the next one */
+   fwrite(&x->shot.generation, sizeof(uint64_t), 1, x->delta);
+   export_plane(x->delta, x->shot.cells, x->shown,
+                (size_t)dims.rows * dims.row_words);
+}
+
+void export_close(frame_export *x)
+{
+   if (x->image == NULL && x->delta == NULL){
+      return;
+   }
+   if ((x->image != NULL && fclose(x->image) != 0)
+       || (x->delta != NULL && fclose(x->delta) != 0)){
+      printf("***ERROR: cannot write frames***\n");
+   }
+   free(x->shot.cells);
+   free(x->shown);
+   free(x->pixels);
+}
+
+/*****************************************/
+/*      TERMINAL RENDER FUNCTIONS        */
+/*****************************************/
+/* A snapshot is drawn into the frame of */
+/* life_common.c, which only sends the   */
+/* squares whose color changed. The      */
+/* board starts on screen row 2 and the  */
+/* counts go under it.                   */
+/*****************************************/
+void print_board(frame *screen, snapshot *shot)
 {
-   int i, con_w = console_width(); 
-   for (i = 0; i < (con_w/2-offset); i++){
-      printf(" ");
+   int r, c;
+   bitword *row;
+   char line[64];
+   frame_begin(screen);
+   for (r = 0; r < dims.rows; r++){
+      row = BIT_ROW(shot->cells, r);
+      for (c = 0; c < dims.columns; c++){
+         frame_square(screen, r, c,
+                      (row[c / WORD_BITS] >> (c % WORD_BITS)) & 1
+                      ? yellow : mild_blue);
+      }
    }
+   sprintf(line, "LIVE CELLS: %lld", (long long)shot->population);
+   frame_text(screen, dims.rows + 3, 1, normal, line);
+   sprintf(line, "GENERATION: %llu", (unsigned long long)shot->generation);
+   frame_text(screen, dims.rows + 4, 1, normal, line);
+   frame_flush(screen);
 }
 
-void known_fill(cell board[][COLUMNS])
+void known_fill(gen_board *board)
 {
    choice config; 
 
    set_color(normal); 
    printf("\n");
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("    Enter number for "); 
    set_color(red);
    printf("KNOWN"); 
    set_color(normal);
    printf(" configuration: \n"); 
    set_color(blue);
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("        GLIDER ----------------- 0: \n");
    set_color(red);
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("        SMALL EXPLODER --------- 1: \n");
    set_color(blue);
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("        EXPLODER --------------- 2: \n");
    set_color(red);
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("        TEN CELL ROW ----------- 3: \n");
    set_color(blue);
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("        LIGHTWEIGHT SPACESHIP -- 4: \n");
    set_color(yellow);
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("        GOSPER GLIDER GUN ------ 5: \n");
    while(!scanf("%d", &config)){
       printf("***ERROR: invalid input***");
@@ -288,7 +4546,7 @@ void known_fill(cell board[][COLUMNS])
    set_known_board(board, config); 
 }
 
-void set_known_board(cell board[][COLUMNS], int config)
+void set_known_board(gen_board *board, int config)
 {
    /* sets the board into a known configuration */
    switch(config){
@@ -316,60 +4574,26 @@ void set_known_board(cell board[][COLUMNS], int config)
    }   
 }
 
-void set_color(int color_choice)
-{
-   switch(color_choice){
-   case blue:
-      printf("\033[1;34m");
-      break;
-   case mild_blue:
-      printf("\033[0;34m");
-      break;
-   case red:
-      printf("\033[1;31m");
-      break;
-   case yellow:
-      printf("\033[1;33m");
-      break;
-   default:
-      printf("\033[0m");
-   }
-}
-
-void clear_console(void)
-{
-   if (!system("clear")){
-      printf(" ");
-   } 
-}
-
-int console_width(void)
-{
-   struct winsize w;
-   ioctl(0, TIOCGWINSZ, &w);
-   return w.ws_col;
-}
-
 int position_r(cell row)
 {
-   return row + ROWS/HALF;
+   return row + dims.plane_rows/HALF;
 }
 
 int position_c(cell col)
 {
-   return col + COLUMNS/QUARTER;
+   return col + dims.columns/QUARTER;
 }
 
 void print_intro(void)
 {
    clear_console();
    printf("\n\n");
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("             THE GAME OF");
    set_color(blue);
    printf(" LIFE\n");
    set_color(red);
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("            cellular automaton\n\n");
 }
 
@@ -379,7 +4603,7 @@ choice get_choice(void)
 
    set_color(normal);
    printf("\n");
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("    For ");
    set_color(red);
    printf("KNOWN");
@@ -390,7 +4614,7 @@ choice get_choice(void)
 
    set_color(normal);
    printf("\n");
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("    For "); 
    set_color(blue); 
    printf("RANDOM"); 
@@ -406,76 +4630,62 @@ choice get_choice(void)
    return input; 
 }
 
-int count_live_cells(cell board[][COLUMNS])
-{
-   /* counts total live cells on the board */
-   int cnt = 0, r, c; 
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         if (board[r][c] == 1){
-            cnt++;
-         } 
-      }
-   }
-   return cnt; 
-}
-
 /*************************************************/
 /*      KNOWN CONFIGURATION SETUP FUNCTIONS      */
 /*************************************************/
-void set_glider(cell board[][COLUMNS])
+void set_glider(gen_board *board)
 {
-   board[position_r(0)][position_c(1)] = 1;
-   board[position_r(1)][position_c(2)] = 1;
-   board[position_r(2)][position_c(0)] = 1;
-   board[position_r(2)][position_c(1)] = 1;
-   board[position_r(2)][position_c(2)] = 1;
+   set_cell(board, position_r(0), position_c(1), alive);
+   set_cell(board, position_r(1), position_c(2), alive);
+   set_cell(board, position_r(2), position_c(0), alive);
+   set_cell(board, position_r(2), position_c(1), alive);
+   set_cell(board, position_r(2), position_c(2), alive);
 }
 
-void set_small_explosion(cell board[][COLUMNS])
+void set_small_explosion(gen_board *board)
 {
-   board[position_r(0)][position_c(1)] = 1; 
-   board[position_r(1)][position_c(1)] = 1;
-   board[position_r(1)][position_c(0)] = 1;
-   board[position_r(1)][position_c(2)] = 1;
-   board[position_r(2)][position_c(2)] = 1;
-   board[position_r(2)][position_c(0)] = 1;
-   board[position_r(3)][position_c(1)] = 1;
+   set_cell(board, position_r(0), position_c(1), alive);
+   set_cell(board, position_r(1), position_c(1), alive);
+   set_cell(board, position_r(1), position_c(0), alive);
+   set_cell(board, position_r(1), position_c(2), alive);
+   set_cell(board, position_r(2), position_c(2), alive);
+   set_cell(board, position_r(2), position_c(0), alive);
+   set_cell(board, position_r(3), position_c(1), alive);
 }
 
-void set_explosion(cell board[][COLUMNS])
+void set_explosion(gen_board *board)
 {
    int i;
    for (i = 0; i<= 4; i++){
-      board[position_r(i)][position_c(0)] = 1;
-      board[position_r(i)][position_c(4)] = 1;
+      set_cell(board, position_r(i), position_c(0), alive);
+      set_cell(board, position_r(i), position_c(4), alive);
    }
-   board[position_r(0)][position_c(2)] = 1;
-   board[position_r(4)][position_c(2)] = 1;
+   set_cell(board, position_r(0), position_c(2), alive);
+   set_cell(board, position_r(4), position_c(2), alive);
 }
 
-void set_ten_cell(cell board[][COLUMNS])
+void set_ten_cell(gen_board *board)
 {
    int i;
    for (i = 0; i < 10; i++){
-      board[position_r(0)][position_c(i)] = 1; 
+      set_cell(board, position_r(0), position_c(i), alive);
    }
 }
 
-void set_light_spaceship(cell board[][COLUMNS])
+void set_light_spaceship(gen_board *board)
 {
    int i;
    for (i = 1; i < 5; i++){
-      board[position_r(0)][position_c(i)] = 1;
+      set_cell(board, position_r(0), position_c(i), alive);
    }
-   board[position_r(1)][position_c(4)] = 1;
-   board[position_r(2)][position_c(4)] = 1;
-   board[position_r(1)][position_c(0)] = 1;
-   board[position_r(3)][position_c(0)] = 1;
-   board[position_r(3)][position_c(3)] = 1;
+   set_cell(board, position_r(1), position_c(4), alive);
+   set_cell(board, position_r(2), position_c(4), alive);
+   set_cell(board, position_r(1), position_c(0), alive);
+   set_cell(board, position_r(3), position_c(0), alive);
+   set_cell(board, position_r(3), position_c(3), alive);
 }
 
-void set_glider_gun(cell board[][COLUMNS])
+void set_glider_gun(gen_board *board)
 {
   block(board, position_r(2), position_c(0));
   block(board, position_r(0), position_c(34)); 
@@ -486,44 +4696,44 @@ void set_glider_gun(cell board[][COLUMNS])
   cannon(board, position_r(12), position_c(24));
 }
 
-void block(cell board[][COLUMNS], cell row, cell col)
+void block(gen_board *board, cell row, cell col)
 {
    /*forms block from starting row moving down and right*/
-   board[row][col] = 1;
-   board[row][col+1] = 1;
-   board[row+1][col] = 1;
-   board[row+1][col+1] = 1;
+   set_cell(board, row, col, alive);
+   set_cell(board, row, col+1, alive);
+   set_cell(board, row+1, col, alive);
+   set_cell(board, row+1, col+1, alive);
 }
 
-void eye(cell board[][COLUMNS], cell row, cell col)
+void eye(gen_board *board, cell row, cell col)
 {
    /*forms eye shape starting from top left*/
-   board[row+1][col] = 1;
-   board[row+2][col] = 1;
-   board[row][col+1] = 1;
-   board[row+2][col+1] = 1;
-   board[row][col+2] = 1;
-   board[row+1][col+2] = 1; 
+   set_cell(board, row+1, col, alive);
+   set_cell(board, row+2, col, alive);
+   set_cell(board, row, col+1, alive);
+   set_cell(board, row+2, col+1, alive);
+   set_cell(board, row, col+2, alive);
+   set_cell(board, row+1, col+2, alive);
 }
 
-void hook(cell board[][COLUMNS], cell row, cell col)
+void hook(gen_board *board, cell row, cell col)
 {
    /*hook shape starting from top left*/
    int i;
    for (i = 0; i < 3; i++){
-      board[i + row][col] = 1;
+      set_cell(board, i + row, col, alive);
    }
-   board[row][col+1] = 1;
-   board[row+1][col+2] = 1; 
+   set_cell(board, row, col+1, alive);
+   set_cell(board, row+1, col+2, alive);
 }
 
-void cannon(cell board[][COLUMNS], cell row, cell col)
+void cannon(gen_board *board, cell row, cell col)
 {
    /*cannon shape starting from top left*/
    int i;
    for (i = 0; i < 3; i++){
-      board[row][i+col] = 1;
+      set_cell(board, row, i+col, alive);
    }
-   board[row+1][col] = 1;
-   board[row+2][col+1] = 1;
+   set_cell(board, row+1, col, alive);
+   set_cell(board, row+2, col+1, alive);
 }
@@ -0,0 +1,974 @@
+/************************************************************/
+/*               THE GAME OF LIFE: SHARED CODE              */
+/*************************************************************
+*  The code life.c and life_extra.c both build with, see     *
+*  life_common.h. Each section keeps the comment it had in   *
+*  the program it came from.                                 *
+*************************************************************/
+
+#include "life_common.h"
+
+life_rule rule;
+profile_log profile;
+volatile sig_atomic_t stop_requested = 0;
+
+/*****************************************/
+/*       BOARD STORAGE FUNCTIONS         */
+/*****************************************/
+/* Boards are carved from one arena      */
+/* whose blocks start on a cache line,   */
+/* and the same two boards are reused    */
+/* for every generation.                 */
+/*****************************************/
+void arena_create(arena *a, size_t size)
+{
+   a->block = malloc(size + CACHE_LINE);
+   if (a->block == NULL){
+      printf("***ERROR: out of memory for the board***\n");
+      exit(1);
+   }
+   a->base = a->block + (CACHE_LINE - (uintptr_t)a->block % CACHE_LINE);
+   a->size = size;
+   a->used = 0;
+}
+
+void *arena_alloc(arena *a, size_t bytes)
+{
+   /* hands out cache-line multiples so every block stays aligned */
+   void *p;
+   bytes = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+   if (a->used + bytes > a->size){
+      printf("***ERROR: board arena exhausted***\n");
+      exit(1);
+   }
+   p = a->base + a->used;
+   a->used += bytes;
+   return p;
+}
+
+void arena_destroy(arena *a)
+{
+   free(a->block);
+   a->block = a->base = NULL;
+   a->size = a->used = 0;
+}
+
+double seconds_now(void)
+{
+   timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*****************************************/
+/*            RULE FUNCTIONS             */
+/*****************************************/
+/* A rule is read from a rulestring once */
+/* and compiled into tables. Cell by     */
+/* cell engines look the next state up   */
+/* from the 3x3 sum, the bit-sliced ones */
+/* match each neighbour count against    */
+/* masks that are all ones or all zeros. */
+/* Neither branches on the rule. B3/S23  */
+/* also keeps the kernels written for it */
+/* so the default rule loses nothing.    */
+/*****************************************/
+bool rule_parse(life_rule *r, char *text)
+{
+   /* reads B3/S23 or S23/B3 in either case, or the older 23/3 */
+   /* with the survivals first. Returns false for anything else */
+   int part, masks[2] = {0, 0}, kinds[2] = {-1, -1};
+   char *p = text;
+   for (part = 0; part < 2; part++){
+      if (toupper((unsigned char)*p) == 'B'
+          || toupper((unsigned char)*p) == 'S'){
+         kinds[part] = toupper((unsigned char)*p) == 'B' ? 0 : 1;
+         p++;
+      }
+      for (; *p >= '0' && *p <= '8'; p++){
+         masks[part] |= 1 << (*p - '0');
+      }
+      if (part == 0 && *p++ != '/'){
+         return false;
+      }
+   }
+   if (*p != '\0'){
+      return false;
+   }
+   if (kinds[0] < 0 && kinds[1] < 0){
+      rule_compile(r, masks[1], masks[0]);
+   } else if (kinds[0] >= 0 && kinds[1] == 1 - kinds[0]){
+      rule_compile(r, masks[kinds[0] == 1], masks[kinds[0] == 0]);
+   } else {
+      return false;
+   }
+   return true;
+}
+
+void rule_compile(life_rule *r, int birth, int survive)
+{
+   /* the tables of the rule with these birth and survival masks */
+   char *p = r->text;
+   int n;
+   r->birth = birth & 0x1ff;
+   r->survive = survive & 0x1ff;
+   r->life = r->birth == 1 << 3 && r->survive == (1 << 2 | 1 << 3);
+   *p++ = 'B';
+   for (n = 0; n <= 8; n++){
+      if (r->birth >> n & 1){
+         *p++ = '0' + n;
+      }
+   }
+   *p++ = '/';
+   *p++ = 'S';
+   for (n = 0; n <= 8; n++){
+      if (r->survive >> n & 1){
+         *p++ = '0' + n;
+      }
+   }
+   *p = '\0';
+   r->next[dead][9] = r->next[alive][0] = dead;
+   for (n = 0; n <= 8; n++){
+      r->next[dead][n] = r->birth >> n & 1;
+      r->next[alive][n + 1] = r->survive >> n & 1;
+      r->born[n] = (bitword)0 - (r->birth >> n & 1);
+      r->kept[n] = (bitword)0 - (r->survive >> n & 1);
+   }
+}
+
+/*****************************************/
+/*      CYCLE DETECTION FUNCTIONS        */
+/*****************************************/
+/* A board's hash is the sum of one hash */
+/* per row, so that bands can hash their */
+/* own rows. The log keeps the hashes of */
+/* the last max_period boards, the first */
+/* one of the run included. A board      */
+/* whose hash was seen p boards ago is   */
+/* kept by the program, once, and        */
+/* compared in full with the board p     */
+/* generations on: a match ends the run  */
+/* and reports the generation of the     */
+/* board kept, and a hash collision      */
+/* costs one copy and one compare.       */
+/*****************************************/
+uint64_t cycle_mix(uint64_t x)
+{
+   /* splitmix64's finaliser: every bit of x moves every bit out */
+   x ^= x >> 30;
+   x *= 0xBF58476D1CE4E5B9ULL;
+   x ^= x >> 27;
+   x *= 0x94D049BB133111EBULL;
+   return x ^ (x >> 31);
+}
+
+uint64_t cycle_row_hash(void *row, size_t bytes, int r)
+{
+   /* the row is read 8 bytes at a time, seeded by its number */
+   unsigned char *p = row;
+   uint64_t word, h = cycle_mix((uint64_t)r + 1);
+   size_t i;
+   for (i = 0; i + sizeof(word) <= bytes; i += sizeof(word)){
+      memcpy(&word, p + i, sizeof(word));
+      h = cycle_mix(h ^ word);
+   }
+   if (i < bytes){
+      word = 0;
+      memcpy(&word, p + i, bytes - i);
+      h = cycle_mix(h ^ word);
+   }
+   return h;
+}
+
+void cycle_log_create(cycle_log *log, int size)
+{
+   /* size 0 looks for nothing */
+   log->size = size;
+   log->count = 0;
+   log->pending = 0;
+   log->hashes = malloc((size > 0 ? size : 1) * sizeof(uint64_t));
+   if (log->hashes == NULL){
+      printf("***ERROR: out of memory for the cycle ring***\n");
+      exit(1);
+   }
+}
+
+void cycle_log_destroy(cycle_log *log)
+{
+   free(log->hashes);
+   log->hashes = NULL;
+}
+
+bool cycle_due(cycle_log *log)
+{
+   /* true when the next board recorded is the one the board kept */
+   /* should come round as                                        */
+   return log->pending != 0 && log->count == log->due;
+}
+
+bool cycle_record(cycle_log *log, uint64_t hash, uint64_t generation)
+{
+   /* records the hash of the latest board, and returns true when */
+   /* that board should be kept, as its hash was seen before. No  */
+   /* more hits are taken while one is kept                       */
+   bool keep = false;
+   int p;
+   if (log->pending != 0 && log->count >= log->due){
+      log->pending = 0;
+   }
+   for (p = 1; log->pending == 0 && p <= log->size
+               && (uint64_t)p <= log->count; p++){
+      if (log->hashes[(log->count - p) % log->size] == hash){
+         log->pending = p;
+         log->due = log->count + p;
+         log->start = generation;
+         keep = true;
+      }
+   }
+   log->hashes[log->count % log->size] = hash;
+   log->count++;
+   return keep;
+}
+
+/*****************************************/
+/*        RANDOM FILL FUNCTIONS          */
+/*****************************************/
+/* Each row of a plane has a stream of   */
+/* its own, keyed by the seed, the row   */
+/* number and the plane, and word n of a */
+/* stream is the mix of the key plus n   */
+/* steps of RANDOM_GAMMA as in           */
+/* splitmix64. Any word can be drawn     */
+/* first, so bands of rows fill on their */
+/* own threads and the board only hangs  */
+/* on the seed. A word of cells comes    */
+/* out whole, each alive with a chance   */
+/* kept to RANDOM_BITS binary places.    */
+/*****************************************/
+uint64_t random_stream(uint64_t seed, int row, int plane)
+{
+   /* the key of one row of a plane: life.c only has plane 0,   */
+   /* in life_extra.c 0 is alive and 1 the immigration color    */
+   return cycle_mix(cycle_mix(seed + RANDOM_GAMMA)
+                    ^ ((uint64_t)row << 8 | plane));
+}
+
+uint64_t random_chance(int density)
+{
+   /* 1 in density as a multiple of 2^-RANDOM_BITS, rounded */
+   return (((uint64_t)1 << RANDOM_BITS) + density / 2) / density;
+}
+
+bitword random_bits(uint64_t key, int w, uint64_t chance)
+{
+   /* word w of a stream, each bit set with chance * 2^-RANDOM_BITS. */
+   /* The chance is read from its lowest set bit up: a 1 ors in a    */
+   /* fresh word and a 0 ands one in, so every bit halves the odds   */
+   /* so far and a 1 adds a half on top                              */
+   uint64_t n = (uint64_t)w * RANDOM_BITS;
+   bitword word = 0, draw;
+   int b;
+   if (chance >= (uint64_t)1 << RANDOM_BITS){
+      return ~(bitword)0;
+   }
+   if (chance == 0){
+      return 0;
+   }
+   for (b = 0; (chance >> b & 1) == 0; b++){
+   }
+   for (; b < RANDOM_BITS; b++){
+      draw = cycle_mix(key + (n + b + 1) * RANDOM_GAMMA);
+      word = chance >> b & 1 ? word | draw : word & draw;
+   }
+   return word;
+}
+
+/*****************************************/
+/*        WORKER POOL FUNCTIONS          */
+/*****************************************/
+/* The threads are started once and kept */
+/* for the whole run. Each one owns a    */
+/* fixed band of rows, and the calling   */
+/* thread works band 0. The program sets */
+/* up its job and posts it, which costs  */
+/* one barrier, and its work function    */
+/* waits on step after each generation   */
+/* of its band.                          */
+/*****************************************/
+void pool_create(worker_pool *p, int threads, pool_work_func work,
+                 void *job)
+{
+   int i;
+   worker_arg *args;
+   p->threads = threads;
+   p->work = work;
+   p->job = job;
+   p->quit = false;
+   p->ids = malloc(threads * sizeof(pthread_t));
+   args = malloc(threads * sizeof(worker_arg));
+   if (p->ids == NULL || args == NULL){
+      printf("***ERROR: out of memory for the worker pool***\n");
+      exit(1);
+   }
+   pthread_barrier_init(&p->start, NULL, threads);
+   pthread_barrier_init(&p->step, NULL, threads);
+   for (i = 1; i < threads; i++){
+      args[i].pool = p;
+      args[i].index = i;
+      pthread_create(&p->ids[i], NULL, pool_thread, &args[i]);
+   }
+   /* the workers have copied their argument once start is passed */
+   pthread_barrier_wait(&p->start);
+   free(args);
+}
+
+void pool_destroy(worker_pool *p)
+{
+   int i;
+   p->quit = true;
+   pthread_barrier_wait(&p->start);
+   for (i = 1; i < p->threads; i++){
+      pthread_join(p->ids[i], NULL);
+   }
+   pthread_barrier_destroy(&p->start);
+   pthread_barrier_destroy(&p->step);
+   free(p->ids);
+}
+
+void pool_post(worker_pool *p)
+{
+   /* runs the job set up in p->job on every band */
+   pthread_barrier_wait(&p->start);
+   p->work(p, 0);
+}
+
+void *pool_thread(void *arg)
+{
+   worker_pool *p = ((worker_arg *)arg)->pool;
+   int index = ((worker_arg *)arg)->index;
+   pthread_barrier_wait(&p->start);
+   while (true){
+      pthread_barrier_wait(&p->start);
+      if (p->quit){
+         break;
+      }
+      p->work(p, index);
+   }
+   return NULL;
+}
+
+/*****************************************/
+/*         CHECKPOINT FUNCTIONS          */
+/*****************************************/
+/* The run only stops to copy its board  */
+/* into a buffer. A writer thread puts   */
+/* that on disk under a temporary name   */
+/* and renames it over the file, so a    */
+/* checkpoint is never found half        */
+/* written. What the planes hold is the  */
+/* program's to fill in.                 */
+/*****************************************/
+void checkpoint_start(checkpoint *ck, char *path, int interval,
+                      size_t bytes)
+{
+   /* a NULL path writes nothing. bytes is what follows the header */
+   ck->path = path;
+   ck->interval = path != NULL ? interval : 0;
+   ck->busy = ck->quit = false;
+   if (path == NULL){
+      return;
+   }
+   ck->bytes = CHECKPOINT_HEADER + bytes;
+   ck->buffer = malloc(ck->bytes);
+   if (ck->buffer == NULL){
+      printf("***ERROR: out of memory for the checkpoint***\n");
+      exit(1);
+   }
+   pthread_mutex_init(&ck->lock, NULL);
+   pthread_cond_init(&ck->wake, NULL);
+   pthread_cond_init(&ck->idle, NULL);
+   pthread_create(&ck->writer, NULL, checkpoint_thread, ck);
+}
+
+void checkpoint_stop(checkpoint *ck)
+{
+   /* returns once the last checkpoint posted is on disk */
+   if (ck->path == NULL){
+      return;
+   }
+   pthread_mutex_lock(&ck->lock);
+   ck->quit = true;
+   pthread_cond_signal(&ck->wake);
+   pthread_mutex_unlock(&ck->lock);
+   pthread_join(ck->writer, NULL);
+   pthread_mutex_destroy(&ck->lock);
+   pthread_cond_destroy(&ck->wake);
+   pthread_cond_destroy(&ck->idle);
+   free(ck->buffer);
+}
+
+checkpoint_header *checkpoint_claim(checkpoint *ck)
+{
+   /* the buffer, once the writer is done with the last one, with */
+   /* the magic and version in a header cleared otherwise. The     */
+   /* planes follow it at CHECKPOINT_HEADER                        */
+   checkpoint_header *header = (checkpoint_header *)ck->buffer;
+   pthread_mutex_lock(&ck->lock);
+   while (ck->busy){
+      pthread_cond_wait(&ck->idle, &ck->lock);
+   }
+   pthread_mutex_unlock(&ck->lock);
+   memset(ck->buffer, 0, CHECKPOINT_HEADER);
+   memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+   header->version = CHECKPOINT_VERSION;
+   return header;
+}
+
+void checkpoint_hand_over(checkpoint *ck)
+{
+   /* gives the writer the buffer filled since checkpoint_claim */
+   pthread_mutex_lock(&ck->lock);
+   ck->busy = true;
+   pthread_cond_signal(&ck->wake);
+   pthread_mutex_unlock(&ck->lock);
+}
+
+void *checkpoint_thread(void *arg)
+{
+   /* writes each buffer posted, until told to quit with none left */
+   checkpoint *ck = arg;
+   pthread_mutex_lock(&ck->lock);
+   while (true){
+      while (!ck->busy && !ck->quit){
+         pthread_cond_wait(&ck->wake, &ck->lock);
+      }
+      if (!ck->busy){
+         break;
+      }
+      pthread_mutex_unlock(&ck->lock);
+      checkpoint_write(ck);
+      pthread_mutex_lock(&ck->lock);
+      ck->busy = false;
+      pthread_cond_signal(&ck->idle);
+   }
+   pthread_mutex_unlock(&ck->lock);
+   return NULL;
+}
+
+void checkpoint_write(checkpoint *ck)
+{
+   /* to path.tmp first, then renamed over path once it is synced */
+   char *tmp = malloc(strlen(ck->path) + 5);
+   size_t done = 0;
+   ssize_t n;
+   int fd = -1;
+   if (tmp != NULL){
+      sprintf(tmp, "%s.tmp", ck->path);
+      fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   }
+   while (fd >= 0 && done < ck->bytes
+          && (n = write(fd, ck->buffer + done, ck->bytes - done)) > 0){
+      done += n;
+   }
+   if (fd < 0 || done < ck->bytes || fsync(fd) != 0 || close(fd) != 0
+       || rename(tmp, ck->path) != 0){
+      printf("***ERROR: cannot write checkpoint %s***\n", ck->path);
+      exit(1);
+   }
+   free(tmp);
+}
+
+bool checkpoint_map_file(checkpoint_map *map, char *path)
+{
+   /* maps the file and checks the header all checkpoints share. */
+   /* The pages are private, so the run may write to them without */
+   /* touching the file. The mode and planes are the program's    */
+   /* to check                                                     */
+   struct stat info;
+   checkpoint_header *h;
+   int fd = open(path, O_RDONLY);
+   if (fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)
+       || info.st_size < CHECKPOINT_HEADER){
+      printf("***ERROR: cannot read checkpoint %s***\n", path);
+      exit(1);
+   }
+   map->bytes = info.st_size;
+   map->base = mmap(NULL, map->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, 0);
+   close(fd);
+   if (map->base == MAP_FAILED){
+      printf("***ERROR: cannot map checkpoint %s***\n", path);
+      exit(1);
+   }
+   h = map->header = (checkpoint_header *)map->base;
+   map->planes = (bitword *)(map->base + CHECKPOINT_HEADER);
+   return memcmp(h->magic, CHECKPOINT_MAGIC, sizeof(h->magic)) == 0
+          && h->version == CHECKPOINT_VERSION
+          && h->rows >= 1 && h->columns >= 1
+          && h->row_words
+             == (uint32_t)(h->columns + WORD_BITS - 1) / WORD_BITS
+          && map->bytes >= CHECKPOINT_HEADER + (size_t)h->planes * h->rows
+                                               * h->row_words
+                                               * sizeof(bitword);
+}
+
+void checkpoint_close(checkpoint_map *map)
+{
+   if (map->base != NULL){
+      munmap(map->base, map->bytes);
+      map->base = NULL;
+   }
+}
+
+void stop_signal(int signal_number)
+{
+   /* a drain or ^C ends a headless run at the next board */
+   (void)signal_number;
+   stop_requested = 1;
+}
+
+/*****************************************/
+/*           PROFILE FUNCTIONS           */
+/*****************************************/
+/* Built with PROFILE set to 1, -o file  */
+/* times the phases of a displayed run:  */
+/* the step, the cycle check, the        */
+/* checkpoint tick, drawing and the      */
+/* sleep between frames. The loop names  */
+/* each phase as it enters it, and the   */
+/* clock is read once per switch. Every  */
+/* generation writes a row of its phase  */
+/* times and counters and adds the times */
+/* to a log2 histogram per phase. At the */
+/* end a final row takes what came after */
+/* the last generation, the last frame   */
+/* among it, and the histogram follows.  */
+/* The file is CSV, or JSON lines if it  */
+/* ends in .json. The calls made every   */
+/* phase are inlined from life_common.h, */
+/* so with PROFILE 0 they fold away.     */
+/*****************************************/
+void profile_open(char *path)
+{
+   char *dot;
+   int i;
+   profile.out = NULL;
+   if (!PROFILE || path == NULL){
+      return;
+   }
+   profile.out = fopen(path, "w");
+   if (profile.out == NULL){
+      printf("***ERROR: cannot write profile %s***\n", path);
+      exit(1);
+   }
+   dot = strrchr(path, '.');
+   profile.json = dot != NULL && strcmp(dot, ".json") == 0;
+   profile.phase = phase_step;
+   profile.entered = profile_now();
+   memset(profile.spent, 0, sizeof(profile.spent));
+   memset(profile.counts, 0, sizeof(profile.counts));
+   memset(profile.histogram, 0, sizeof(profile.histogram));
+   if (!profile.json){
+      fprintf(profile.out, "record,generation");
+      for (i = 0; i < profile_phases; i++){
+         fprintf(profile.out, ",%s_ns", profile_phase_names[i]);
+      }
+      for (i = 0; i < profile_counters; i++){
+         fprintf(profile.out, ",%s", profile_counter_names[i]);
+      }
+      fprintf(profile.out, "\n");
+   }
+}
+
+void profile_close(uint64_t generation)
+{
+   /* a final row of what came after the last generation's, such as */
+   /* the last frame, then one histogram row for each bucket any     */
+   /* phase fell in, holding the generations of each phase that took */
+   /* 2^b .. 2^(b+1)-1 ns                                            */
+   uint64_t floor_ns, used;
+   int b, i;
+   if (!PROFILE || profile.out == NULL){
+      return;
+   }
+   profile_row("final", generation, false);
+   for (b = 0; b < PROFILE_BUCKETS; b++){
+      used = 0;
+      for (i = 0; i < profile_phases; i++){
+         used += profile.histogram[i][b];
+      }
+      if (used == 0){
+         continue;
+      }
+      floor_ns = b == 0 ? 0 : (uint64_t)1 << b;
+      if (profile.json){
+         fprintf(profile.out, "{\"record\":\"histogram\",\"floor_ns\":%llu",
+                 (unsigned long long)floor_ns);
+      } else {
+         fprintf(profile.out, "histogram,%llu", (unsigned long long)floor_ns);
+      }
+      for (i = 0; i < profile_phases; i++){
+         if (profile.json){
+            fprintf(profile.out, ",\"%s\":%llu", profile_phase_names[i],
+                    (unsigned long long)profile.histogram[i][b]);
+         } else {
+            fprintf(profile.out, ",%llu",
+                    (unsigned long long)profile.histogram[i][b]);
+         }
+      }
+      fprintf(profile.out, profile.json ? "}\n" : ",,,\n");
+   }
+   if (fclose(profile.out) != 0){
+      printf("***ERROR: cannot write profile***\n");
+   }
+   profile.out = NULL;
+}
+
+void profile_row(char *record, uint64_t generation, bool histogram)
+{
+   /* writes the phase times and counters since the last row */
+   uint64_t spent;
+   int64_t count;
+   int b, i;
+   profile_enter(profile.phase);
+   if (profile.json){
+      fprintf(profile.out, "{\"record\":\"%s\",\"generation\":%llu", record,
+              (unsigned long long)generation);
+   } else {
+      fprintf(profile.out, "%s,%llu", record, (unsigned long long)generation);
+   }
+   for (i = 0; i < profile_phases; i++){
+      spent = profile.spent[i];
+      b = 0;
+      while (b < PROFILE_BUCKETS - 1 && spent >> (b + 1) != 0){
+         b++;
+      }
+      if (histogram){
+         profile.histogram[i][b]++;
+      }
+      if (profile.json){
+         fprintf(profile.out, ",\"%s_ns\":%llu", profile_phase_names[i],
+                 (unsigned long long)spent);
+      } else {
+         fprintf(profile.out, ",%llu", (unsigned long long)spent);
+      }
+      profile.spent[i] = 0;
+   }
+   for (i = 0; i < profile_counters; i++){
+      count = ATOMIC_LOAD(&profile.counts[i]);
+      ATOMIC_ADD(&profile.counts[i], -count);
+      if (profile.json){
+         fprintf(profile.out, ",\"%s\":%lld", profile_counter_names[i],
+                 (long long)count);
+      } else {
+         fprintf(profile.out, ",%lld", (long long)count);
+      }
+   }
+   fprintf(profile.out, profile.json ? "}\n" : "\n");
+   /* writing the row is not part of any phase */
+   profile.entered = profile_now();
+}
+
+/*****************************************/
+/*       FRAME SCHEDULER FUNCTIONS       */
+/*****************************************/
+/* Without -v a displayed run draws each */
+/* generation and holds it FRAME_NS. -v  */
+/* rate sets frames a second instead,    */
+/* and as many generations are stepped   */
+/* between two frames as fit before the  */
+/* next one is due, going by how long    */
+/* the last one took. -u generations are */
+/* stepped first with no frames and no   */
+/* waiting at all.                       */
+/*****************************************/
+void pace_start(frame_pace *p, int rate, int turbo)
+{
+   p->period = rate > 0 ? 1.0 / rate : 0;
+   p->turbo = turbo;
+   p->last = p->deadline = seconds_now();
+   p->step = 0;
+}
+
+bool pace_due(frame_pace *p)
+{
+   /* asked before each generation, true when a frame comes first */
+   double now = seconds_now();
+   if (p->turbo > 0){
+      p->turbo--;
+      p->last = now;
+      return false;
+   }
+   if (p->period == 0){
+      return true;
+   }
+   p->step = now - p->last;
+   p->last = now;
+   return now + p->step >= p->deadline;
+}
+
+void pace_wait(frame_pace *p)
+{
+   /* holds the frame until the next is due. A run that fell */
+   /* behind starts again from now instead of catching up    */
+   timespec tim;
+   double now = seconds_now(), left;
+   left = p->period == 0 ? FRAME_NS / 1e9 : p->deadline - now;
+   if (left > 0){
+      tim.tv_sec = (time_t)left;
+      tim.tv_nsec = (long)((left - tim.tv_sec) * 1e9);
+      nanosleep(&tim, NULL);
+   }
+   p->deadline = (p->deadline > now ? p->deadline : now) + p->period;
+   p->last = seconds_now();
+}
+
+/*****************************************/
+/*        FRAME EXPORT FUNCTIONS         */
+/*****************************************/
+/* The delta log that -j writes opens    */
+/* with a DELTA_MAGIC header of the      */
+/* planes, rows, columns and row words   */
+/* as uint32s. Each generation then has  */
+/* its number as a uint64 and, plane     */
+/* after plane, the words XORed with the */
+/* generation before as pairs of runs of */
+/* unchanged and changed words. The run  */
+/* lengths are varints, the changed      */
+/* words follow their run as they are.   */
+/*****************************************/
+FILE *export_file(char *path)
+{
+   /* - is stdout, and what the run prints goes to stderr from then */
+   FILE *out;
+   if (strcmp(path, "-") == 0){
+      out = fdopen(dup(STDOUT_FILENO), "wb");
+      dup2(STDERR_FILENO, STDOUT_FILENO);
+   } else {
+      out = fopen(path, "wb");
+   }
+   if (out == NULL){
+      printf("***ERROR: cannot write frames to %s***\n", path);
+      exit(1);
+   }
+   return out;
+}
+
+void export_header(FILE *out, int planes, int rows, int columns,
+                   int row_words)
+{
+   uint32_t head[4];
+   head[0] = planes;
+   head[1] = rows;
+   head[2] = columns;
+   head[3] = row_words;
+   fwrite(DELTA_MAGIC, 1, strlen(DELTA_MAGIC), out);
+   fwrite(head, sizeof(uint32_t), 4, out);
+}
+
+void export_plane(FILE *out, bitword *now, bitword *was, size_t words)
+{
+   /* was is brought up to date one changed run at a time, after */
+   /* the run is XORed with now and written                      */
+   size_t at = 0, start;
+   while (at < words){
+      start = at;
+      while (at < words && now[at] == was[at]){
+         at++;
+      }
+      export_varint(out, at - start);
+      start = at;
+      while (at < words && now[at] != was[at]){
+         was[at] ^= now[at];
+         at++;
+      }
+      export_varint(out, at - start);
+      fwrite(was + start, sizeof(bitword), at - start, out);
+      memcpy(was + start, now + start, (at - start) * sizeof(bitword));
+   }
+}
+
+void export_varint(FILE *out, uint64_t n)
+{
+   /* seven bits a byte, lowest first, the top bit set on all but */
+   /* the last                                                    */
+   while (n >= 0x80){
+      putc((int)(n & 0x7f) | 0x80, out);
+      n >>= 7;
+   }
+   putc((int)n, out);
+}
+
+/*****************************************/
+/*      TERMINAL RENDER FUNCTIONS        */
+/*****************************************/
+/* A frame is built in one buffer and    */
+/* sent with a single write. The screen  */
+/* is cleared once and after that only   */
+/* the squares whose color changed are   */
+/* redrawn, reached with cursor escapes, */
+/* and a color escape is only sent when  */
+/* the color differs from the last one.  */
+/* The board starts on screen row 2.     */
+/*****************************************/
+void frame_create(frame *f, int rows, int columns)
+{
+   /* the cursor is left 3 rows under the board, or under any text */
+   /* written lower down                                           */
+   size_t squares = (size_t)rows * columns;
+   f->buffer = malloc(squares * FRAME_SQUARE_BYTES + FRAME_SLACK);
+   f->shown = malloc(squares);
+   if (f->buffer == NULL || f->shown == NULL){
+      printf("***ERROR: out of memory for the display***\n");
+      exit(1);
+   }
+   f->rows = rows;
+   f->columns = columns;
+   f->foot = rows + 4;
+   f->drawn = false;
+}
+
+void frame_destroy(frame *f)
+{
+   free(f->buffer);
+   free(f->shown);
+   f->buffer = NULL;
+   f->shown = NULL;
+}
+
+void frame_begin(frame *f)
+{
+   /* the console width is read once a frame. The screen is cleared */
+   /* for the first frame or when a resize has moved the board      */
+   int margin = console_width()/2 - f->columns/2;
+   if (margin < 0){
+      margin = 0;
+   }
+   f->used = 0;
+   if (!f->drawn || margin != f->margin){
+      strcpy(f->buffer, "\033[0m\033[H\033[2J");
+      f->used = strlen(f->buffer);
+      memset(f->shown, FRAME_UNSHOWN, (size_t)f->rows * f->columns);
+      f->margin = margin;
+      f->row = f->column = 1;
+      f->color = normal;
+      f->drawn = true;
+   }
+}
+
+void frame_move(frame *f, int row, int column)
+{
+   if (f->row != row || f->column != column){
+      f->used += sprintf(f->buffer + f->used, "\033[%d;%dH", row, column);
+      f->row = row;
+      f->column = column;
+   }
+}
+
+void frame_color(frame *f, int color)
+{
+   if (f->color != color){
+      strcpy(f->buffer + f->used, color_code(color));
+      f->used += strlen(f->buffer + f->used);
+      f->color = color;
+   }
+}
+
+void frame_square(frame *f, int row, int col, int color)
+{
+   /* draws one square, unless the screen already shows it */
+   size_t i = (size_t)row * f->columns + col;
+   if (f->shown[i] == color){
+      return;
+   }
+   f->shown[i] = color;
+   frame_move(f, row + 2, f->margin + col + 1);
+   frame_color(f, color);
+   f->buffer[f->used++] = '#';
+   f->column++;
+}
+
+void frame_text(frame *f, int row, int column, int color, char *text)
+{
+   /* text is short, it goes through FRAME_SLACK */
+   frame_move(f, row, column);
+   frame_color(f, color);
+   f->used += sprintf(f->buffer + f->used, "%s\033[K", text);
+   f->column += strlen(text);
+   if (row >= f->foot){
+      f->foot = row + 1;
+   }
+}
+
+void frame_flush(frame *f)
+{
+   /* leaves the cursor under the board, then sends the frame */
+   ssize_t sent;
+   size_t done = 0;
+   frame_move(f, f->foot, 1);
+   frame_color(f, normal);
+   fflush(stdout);
+   while (done < f->used){
+      sent = write(STDOUT_FILENO, f->buffer + done, f->used - done);
+      if (sent <= 0){
+         break;
+      }
+      done += sent;
+   }
+   profile_count(count_written, (int64_t)done);
+}
+
+/*****************************************/
+/*           HELPER FUNCTIONS            */
+/*****************************************/
+void set_color(int color_choice)
+{
+   printf("%s", color_code(color_choice));
+}
+
+char *color_code(int color_choice)
+{
+   /* the escape that sets a color */
+   switch(color_choice){
+   case blue:
+      return "\033[1;34m";
+   case mild_blue:
+      return "\033[0;34m";
+   case red:
+      return "\033[1;31m";
+   case yellow:
+      return "\033[1;33m";
+   case cyan:
+      return "\033[1;36m";
+   case green:
+      return "\033[1;32m";
+   case magenta:
+      return "\033[1;35m";
+   default:
+      return "\033[0m";
+   }
+}
+
+void clear_console(void)
+{
+   if (!system("clear")){
+      printf(" ");
+   }
+}
+
+int console_width(void)
+{
+   struct winsize w;
+   if (ioctl(0, TIOCGWINSZ, &w) != 0){
+      return 0;
+   }
+   return w.ws_col;
+}
+
+void position_text(int offset)
+{
+   int i, con_w = console_width();
+   for (i = 0; i < (con_w/2-offset); i++){
+      printf(" ");
+   }
+}
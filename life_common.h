@@ -0,0 +1,334 @@
+/************************************************************/
+/*               THE GAME OF LIFE: SHARED CODE              */
+/*************************************************************
+*  What life.c and life_extra.c both run, built into each:   *
+*          gcc ... life.c life_common.c -o life              *
+*          gcc ... life_extra.c life_common.c -o life_extra  *
+*  It knows nothing of either program's boards: the worker   *
+*  pool runs jobs a program posts, the cycle log keeps       *
+*  hashes, and checkpoints and frame exports take planes.    *
+*  Both must be built with the same -DPROFILE.               *
+*************************************************************/
+
+#ifndef LIFE_COMMON_H
+#define LIFE_COMMON_H
+
+#define _POSIX_C_SOURCE 200809L
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<time.h>
+#include<pthread.h>
+#include<signal.h>
+#include<ctype.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/ioctl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#ifdef __GNUC__
+#define ALWAYS_INLINE __inline__ __attribute__((always_inline))
+/* ordered loads and stores of what two threads share without a lock */
+#define ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#else
+#define ALWAYS_INLINE
+#define ATOMIC_LOAD(p) (*(p))
+#define ATOMIC_STORE(p, v) (*(p) = (v))
+#define ATOMIC_ADD(p, v) (*(p) += (v))
+#endif
+
+#define CACHE_LINE 64
+#define WORD_BITS 64
+#define RANDOM_BITS 24
+#define RANDOM_GAMMA 0x9E3779B97F4A7C15ULL
+#define FRAME_SQUARE_BYTES 40
+#define FRAME_SLACK 512
+#define FRAME_UNSHOWN 0xff
+#define FRAME_NS 250000000
+#define CHECKPOINT_MAGIC "LIFECKPT"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_HEADER 64
+#define RULE "B3/S23"
+#define RULE_TEXT 24
+#define DELTA_MAGIC "LIFEDLTA"
+/* -DPROFILE=1 times the phases of a displayed run with -o */
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+#define PROFILE_BUCKETS 48
+
+enum cell_state {dead = 0, alive = 1, set_alive = 3, hold = 4};
+enum color {red, yellow, blue, mild_blue, normal, cyan,
+            green, magenta};
+typedef enum color color;
+enum bool {false, true};
+typedef enum bool bool;
+typedef int cell;
+typedef int choice;
+typedef uint64_t bitword;
+enum profile_phase {phase_step, phase_compare, phase_checkpoint, phase_render,
+                    phase_sleep, profile_phases};
+enum profile_counter {count_evaluated, count_skipped, count_written,
+                      profile_counters};
+typedef struct timespec timespec;
+struct _arena {
+   unsigned char *block;
+   unsigned char *base;
+   size_t size;
+   size_t used;
+};
+typedef struct _arena arena;
+struct _life_rule {
+   /* an outer totalistic rule, as the tables the engines step with */
+   char text[RULE_TEXT]; /* B.../S... as it is shown                */
+   int birth;            /* bit n: born with n live neighbours       */
+   int survive;          /* bit n: survives with n live neighbours   */
+   bool life;            /* B3/S23, which has kernels of its own     */
+   cell next[2][10];     /* [state][live cells of the 3x3 block]     */
+   bitword born[9];      /* all ones where a dead cell with n        */
+   bitword kept[9];      /* or a live one with n neighbours lives    */
+};
+typedef struct _life_rule life_rule;
+struct _cycle_log {
+   /* the hashes of the last size boards, to spot a repeat, and    */
+   /* the hit whose board the program keeps until it comes round   */
+   uint64_t *hashes;
+   int size;
+   uint64_t count;      /* boards recorded, n's hash at n % size   */
+   int pending;         /* period of the hit kept, 0 for none      */
+   uint64_t due;        /* count at which it is confirmed          */
+   uint64_t start;      /* generation of the kept board            */
+};
+typedef struct _cycle_log cycle_log;
+struct _worker_pool;
+typedef void (*pool_work_func)(struct _worker_pool *p, int index);
+struct _worker_pool {
+   int threads;
+   pthread_t *ids;
+   pthread_barrier_t start;   /* a new job has been posted        */
+   pthread_barrier_t step;    /* every band of a generation done  */
+   pool_work_func work;       /* a band's part of the job posted  */
+   void *job;                 /* the program's own job            */
+   bool quit;
+};
+typedef struct _worker_pool worker_pool;
+struct _worker_arg {
+   worker_pool *pool;
+   int index;
+};
+typedef struct _worker_arg worker_arg;
+struct _checkpoint_header {
+   /* the start of a checkpoint file, the bit planes follow at      */
+   /* CHECKPOINT_HEADER, one row of row_words words after another   */
+   char magic[8];         /* CHECKPOINT_MAGIC                        */
+   uint32_t version;      /* CHECKPOINT_VERSION                      */
+   uint32_t mode;         /* which program's board, and its version  */
+   int32_t rows;
+   int32_t columns;
+   uint64_t generation;
+   uint64_t seed;         /* the run's random fill seed              */
+   uint32_t planes;       /* bit planes after the header             */
+   uint32_t row_words;
+   uint32_t birth;        /* the rule's life_rule masks              */
+   uint32_t survive;
+};
+typedef struct _checkpoint_header checkpoint_header;
+struct _checkpoint {
+   /* a writer thread, so the run only stops to copy the board */
+   char *path;
+   int interval;          /* generations between checkpoints   */
+   pthread_t writer;
+   pthread_mutex_t lock;
+   pthread_cond_t wake;   /* a snapshot was posted, or quit    */
+   pthread_cond_t idle;   /* the last snapshot is on disk      */
+   unsigned char *buffer; /* the header and planes to write    */
+   size_t bytes;
+   bool busy;
+   bool quit;
+};
+typedef struct _checkpoint checkpoint;
+struct _checkpoint_map {
+   /* a checkpoint file mapped to resume from */
+   unsigned char *base;   /* NULL when there is none */
+   size_t bytes;
+   checkpoint_header *header;
+   bitword *planes;
+};
+typedef struct _checkpoint_map checkpoint_map;
+struct _profile_log {
+   /* phase times and counters of the displayed run, with PROFILE */
+   FILE *out;                 /* NULL when not asked for with -o     */
+   bool json;
+   int phase;                 /* the phase the run is in             */
+   uint64_t entered;          /* ns when it entered it               */
+   uint64_t spent[profile_phases];   /* ns in each this generation  */
+   int64_t counts[profile_counters]; /* this generation             */
+   uint64_t histogram[profile_phases][PROFILE_BUCKETS];
+};
+typedef struct _profile_log profile_log;
+struct _frame_pace {
+   /* when a displayed run draws its next frame, in seconds */
+   double period;    /* between two frames, 0 for every generation */
+   double deadline;  /* when the next frame is due                 */
+   double last;      /* when the last generation was started       */
+   double step;      /* how long the last generation took          */
+   int turbo;        /* generations left to step without frames    */
+};
+typedef struct _frame_pace frame_pace;
+struct _frame {
+   /* what the terminal shows, so a frame only sends the changes */
+   char *buffer;         /* escapes of one frame, sent in one write */
+   size_t used;
+   unsigned char *shown; /* color of each square on the screen      */
+   int rows, columns;    /* of the board drawn                      */
+   int margin;           /* columns left of the board               */
+   int foot;             /* screen row the cursor is left on        */
+   int row, column;      /* where the cursor is, from 1             */
+   int color;            /* color the terminal is set to            */
+   bool drawn;           /* the screen holds an earlier frame       */
+};
+typedef struct _frame frame;
+
+/* BOARD STORAGE FUNCTIONS */
+void arena_create(arena *a, size_t size);
+void *arena_alloc(arena *a, size_t bytes);
+void arena_destroy(arena *a);
+double seconds_now(void);
+/* RULE FUNCTIONS */
+bool rule_parse(life_rule *r, char *text);
+void rule_compile(life_rule *r, int birth, int survive);
+static ALWAYS_INLINE bitword rule_word(bitword ones, bitword twos,
+                                       bitword fours, bitword eights,
+                                       bitword mid);
+/* CYCLE DETECTION FUNCTIONS */
+uint64_t cycle_mix(uint64_t x);
+uint64_t cycle_row_hash(void *row, size_t bytes, int r);
+void cycle_log_create(cycle_log *log, int size);
+void cycle_log_destroy(cycle_log *log);
+bool cycle_due(cycle_log *log);
+bool cycle_record(cycle_log *log, uint64_t hash, uint64_t generation);
+/* RANDOM FILL FUNCTIONS */
+uint64_t random_stream(uint64_t seed, int row, int plane);
+uint64_t random_chance(int density);
+bitword random_bits(uint64_t key, int w, uint64_t chance);
+/* WORKER POOL FUNCTIONS */
+void pool_create(worker_pool *p, int threads, pool_work_func work,
+                 void *job);
+void pool_destroy(worker_pool *p);
+void pool_post(worker_pool *p);
+void *pool_thread(void *arg);
+/* CHECKPOINT FUNCTIONS */
+void checkpoint_start(checkpoint *ck, char *path, int interval,
+                      size_t bytes);
+void checkpoint_stop(checkpoint *ck);
+checkpoint_header *checkpoint_claim(checkpoint *ck);
+void checkpoint_hand_over(checkpoint *ck);
+void *checkpoint_thread(void *arg);
+void checkpoint_write(checkpoint *ck);
+bool checkpoint_map_file(checkpoint_map *map, char *path);
+void checkpoint_close(checkpoint_map *map);
+void stop_signal(int signal_number);
+/* PROFILE FUNCTIONS */
+void profile_open(char *path);
+void profile_close(uint64_t generation);
+void profile_row(char *record, uint64_t generation, bool histogram);
+static ALWAYS_INLINE uint64_t profile_now(void);
+static ALWAYS_INLINE void profile_enter(int phase);
+static ALWAYS_INLINE void profile_count(int counter, int64_t n);
+static ALWAYS_INLINE void profile_generation(uint64_t generation);
+/* FRAME SCHEDULER FUNCTIONS */
+void pace_start(frame_pace *p, int rate, int turbo);
+bool pace_due(frame_pace *p);
+void pace_wait(frame_pace *p);
+/* FRAME EXPORT FUNCTIONS */
+FILE *export_file(char *path);
+void export_header(FILE *out, int planes, int rows, int columns,
+                   int row_words);
+void export_plane(FILE *out, bitword *now, bitword *was, size_t words);
+void export_varint(FILE *out, uint64_t n);
+/* TERMINAL RENDER FUNCTIONS */
+void frame_create(frame *f, int rows, int columns);
+void frame_destroy(frame *f);
+void frame_begin(frame *f);
+void frame_move(frame *f, int row, int column);
+void frame_color(frame *f, int color);
+void frame_square(frame *f, int row, int col, int color);
+void frame_text(frame *f, int row, int column, int color, char *text);
+void frame_flush(frame *f);
+/* HELPER FUNCTIONS */
+void set_color(int color_choice);
+char *color_code(int color_choice);
+void clear_console(void);
+int console_width(void);
+void position_text(int offset);
+
+extern life_rule rule;
+extern profile_log profile;
+/* the names of the phases and counters, each program's own */
+extern char *profile_phase_names[];
+extern char *profile_counter_names[];
+extern volatile sig_atomic_t stop_requested;
+
+/*****************************************/
+/*       INLINED RULE AND PROFILE        */
+/*****************************************/
+/* These run once per word or per phase, */
+/* so they are inlined into each program */
+/* and with PROFILE 0 the profile calls  */
+/* fold away.                            */
+/*****************************************/
+static ALWAYS_INLINE bitword rule_word(bitword ones, bitword twos,
+                                       bitword fours, bitword eights,
+                                       bitword mid)
+{
+   /* the next state of 64 cells whose neighbour counts are given */
+   /* one binary digit per plane. Each count is matched in turn   */
+   bitword out = 0, match;
+   int n;
+   for (n = 0; n <= 8; n++){
+      match = (n & 1 ? ones : ~ones) & (n & 2 ? twos : ~twos)
+              & (n & 4 ? fours : ~fours) & (n & 8 ? eights : ~eights);
+      out |= match & ((rule.born[n] & ~mid) | (rule.kept[n] & mid));
+   }
+   return out;
+}
+
+static ALWAYS_INLINE uint64_t profile_now(void)
+{
+   timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static ALWAYS_INLINE void profile_enter(int phase)
+{
+   /* the time since the last switch goes to the phase being left */
+   uint64_t now;
+   if (PROFILE && profile.out != NULL){
+      now = profile_now();
+      profile.spent[profile.phase] += now - profile.entered;
+      profile.phase = phase;
+      profile.entered = now;
+   }
+}
+
+static ALWAYS_INLINE void profile_count(int counter, int64_t n)
+{
+   /* a render thread adds the bytes it writes */
+   if (PROFILE && profile.out != NULL){
+      ATOMIC_ADD(&profile.counts[counter], n);
+   }
+}
+
+static ALWAYS_INLINE void profile_generation(uint64_t generation)
+{
+   /* ends the row of a generation once its board is checked */
+   if (PROFILE && profile.out != NULL){
+      profile_row("generation", generation, true);
+   }
+}
+
+#endif
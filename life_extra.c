@@ -6,7 +6,8 @@
 *      cell is determined by the majority color of           *
 *      its parents. Over time one color may dominate         *
 *      -to run this version, input 0 at the start.           *
-*      -this version is achieved using a 2D array of structs *
+*      -this version is achieved using bit planes, one bit   *
+*       per square for alive and one for the color           *
 *      -functions for the advanced version appear            *
 *       at the end of the file and all begin with "im_"      *
 *  3. Advanced Color life (life cycle)                       *
@@ -16,86 +17,504 @@
 *                 Child = green                              *
 *                 Adult = yellow                             *
 *      -to run this version, input 1 at the start            *
-*  NOTE please compile using -w to for nanosleep             *
+*  The board size is chosen at run time and generations can *
+*  be split across a pool of threads:                        *
+*          ./life_extra [rows columns [threads]]             *
+*  Only tiles of the board next to a change last generation  *
+*  are recomputed.                                           *
+*  Color life keeps the age of a square in two more planes.  *
+*  Only the squares that changed are redrawn, each frame is  *
+*  sent in a single write.                                   *
+*  A run ends once the board repeats with any period up to   *
+*  -p (default 64), found from a hash of each board.         *
+*  The squares of each color, births and deaths are counted  *
+*  by the generation kernels as they step.                   *
+*  A binary checkpoint is written in the background every -i *
+*  generations and at the end, and a run resumes from one by *
+*  mapping its planes as the first board:                    *
+*          ./life_extra -c file [-i generations] ...         *
+*          ./life_extra -r file ...                          *
+*  Any outer totalistic rule can be given as a rulestring,   *
+*  and is compiled into masks the kernels step with. B3/S23  *
+*  keeps kernels of its own:                                 *
+*          ./life_extra -l B36/S23 ...                       *
+*  The random fill only hangs on -s. Each row draws whole    *
+*  words from a stream of its own, so the threads fill their *
+*  bands of the board side by side.                          *
+*  An ensemble plays many immigration runs from seeds -s,    *
+*  -s+1 ... on every core with no display, each until a      *
+*  color dies out or the board repeats, and reports how      *
+*  often each color wins and how long it took:               *
+*          ./life_extra -e runs [-g gens] [rows columns ...] *
+*  A headless run and a benchmark suite are picked with      *
+*  options ahead of the board size:                          *
+*          ./life_extra -n [-m mode] [-g gens] [-d density]  *
+*                          [-s seed] [rows columns ...]      *
+*          ./life_extra -b [rows columns [threads]]          *
+*  Built with -DPROFILE=1, the phases of a displayed run are *
+*  timed each generation and written with counters and       *
+*  histograms as CSV or JSON lines:                          *
+*          gcc -DPROFILE=1 ... && ./life_extra -o p.json ... *
+*  A displayed run can draw -v frames a second, stepping as  *
+*  many generations between them as there is time for, and  *
+*  step -u generations first without drawing:               *
+*          ./life_extra -v 30 -u 10000 ...                   *
+*  A headless run can write every generation as a stream of *
+*  PPM frames, and as a log of the words that changed run-  *
+*  length encoded, to a file or stdout:                     *
+*          ./life_extra -n -a - ... | ffmpeg -f image2pipe   *
+*          ./life_extra -n -j run.delta ...                  *
+*  NOTE please compile with life_common.c and -pthread:      *
+*          gcc -O2 -pthread life_extra.c life_common.c       *
+*              -o life_extra                                 *
 *************************************************************/
 
-#include<stdio.h>
-#include<stdlib.h>
-#include<time.h>
-#include<sys/ioctl.h>
+#include "life_common.h"
 
-#define ROWS 60
-#define COLUMNS 80
+#define DEFAULT_ROWS 60
+#define DEFAULT_COLUMNS 80
 #define DENSITY 5
 #define COLOR_DENSITY 2
 #define GENERATIONS 500
 #define QUARTER 4
+#define TILE_SIZE 16
+#define BENCH_SEED 1
+#define BENCH_WARMUP 64
+#define BENCH_WINDOW 256
+#define BENCH_REPEATS 5
+#define BENCH_CELL_UPDATES (1 << 24)
+#define MAX_PERIOD 64
+#define ENSEMBLE_Z 1.96
+/* row r of a bit plane */
+#define PLANE_ROW(plane, r) ((plane) + (size_t)(r) * dims.row_words)
 
-enum cell_state {dead = 0, alive = 1, set_alive = 3, hold = 4};
-enum color {red, yellow, blue, mild_blue, normal, cyan, 
-            green, magenta};
-typedef enum color color;
-enum bool {false, true};
-typedef enum bool bool; 
 enum start_choice {immigration_life, adv_life}; 
-typedef int cell;
-typedef int state; 
-typedef int choice;
-struct _square {
-   state cell_state;
-   int cell_color;
+typedef unsigned char tile_flag;
+enum tile_state {tile_still, tile_changed, tile_filled};
+enum ensemble_outcome {red_wins, yellow_wins, all_dead, periodic,
+                       undecided, unplayed};
+struct _im_census {
+   /* the squares of a tile or a band by state. Red and cyan are */
+   /* the rest of the population                                 */
+   int population;
+   int births;       /* came alive in the step that made it   */
+   int deaths;       /* died in that step                     */
+   int yellow;       /* immigration yellow, color life adults */
+   int green;        /* color life children                   */
 };
-typedef struct _square square;
-struct _square_sums {
-   int sum_cell;
-   int sum_color;
+typedef struct _im_census im_census;
+struct _im_stats {
+   /* census of a whole board, kept up as it is made */
+   uint64_t generation;
+   int population;
+   int births;
+   int deaths;
+   int red;          /* immigration only */
+   int yellow;
+   int cyan;         /* color life only  */
+   int green;
 };
-typedef struct _square_sums square_sums; 
-struct timespec {
-   time_t tv_sec;
-   long tv_nsec;
+typedef struct _im_stats im_stats;
+struct _im_board {
+   /* one bit plane per field, bit i of word w is column 64*w + i */
+   /* of that row. The planes a version does not use are NULL     */
+   choice version;
+   bitword *alive;
+   bitword *colour;  /* immigration: 1 yellow, 0 red (alive only) */
+   bitword *age_lo;  /* color life: age as two bits, 0 birth      */
+   bitword *age_hi;  /* (cyan), 1 child (green), 2 adult (yellow) */
+   uint64_t hash;    /* of the planes, set by im_step             */
+   im_census *census;/* of each tile                              */
+   im_stats stats;   /* set by im_step                            */
 };
-typedef struct timespec timespec;
+typedef struct _im_board im_board;
+struct _dimensions {
+   int rows;
+   int columns;
+   int row_words;    /* bitwords in a plane row                */
+   int last_bits;    /* columns held by the last word of a row */
+   int tile_rows;    /* tiles are TILE_SIZE rows by one word   */
+   int tile_columns; /* so there are row_words across          */
+};
+typedef struct _dimensions dimensions;
+typedef bool (*rows_func)(im_board *current, im_board *next, int first,
+                          int last, int first_word, int last_word,
+                          im_census *census);
+struct _band_share {
+   /* what one band of rows adds to the next board */
+   uint64_t hash;
+   im_census census;
+   int64_t evaluated;   /* squares stepped, with PROFILE         */
+   int64_t skipped;     /* tiles left as they were, with PROFILE */
+};
+typedef struct _band_share band_share;
+struct _tile_map {
+   tile_flag *changed;      /* current's tiles that differ from 2 boards ago */
+   tile_flag *next_changed; /* filled in while the next board is made       */
+};
+typedef struct _tile_map tile_map;
+struct _pool_job {
+   /* what the worker pool is posted to do */
+   rows_func rows;
+   im_board *current;
+   im_board *next;
+   band_share *shares;        /* each band's hash and census      */
+   tile_flag *changed;
+   tile_flag *next_changed;
+   int generations;
+   im_board *fill;            /* filled at random instead, or NULL */
+   uint64_t fill_seed;
+};
+typedef struct _pool_job pool_job;
+struct _frame_export {
+   /* where a headless run writes each generation, with -a and -j */
+   FILE *image;              /* PPM frames, or NULL                */
+   FILE *delta;              /* delta log, or NULL                 */
+   int planes;               /* bit planes of the version          */
+   bitword *shown;           /* the planes of the generation before */
+   unsigned char *pixels;    /* one row of a frame                 */
+   unsigned char palette[8][3]; /* RGB of each 3 bits of a square  */
+};
+typedef struct _frame_export frame_export;
+struct _cycle_ring {
+   /* the cycle log, and one board kept from a hit until it should */
+   /* come round again                                             */
+   cycle_log log;
+   arena store;
+   im_board kept;
+};
+typedef struct _cycle_ring cycle_ring;
+struct _run_options {
+   bool headless;    /* no intro, prompts, console or delay */
+   int generations;  /* generations to run                  */
+   int density;      /* 1 in density cells start alive      */
+   unsigned seed;    /* for the random fill                 */
+   choice mode;      /* immigration_life or adv_life        */
+   int max_period;   /* longest cycle looked for, 0 for none */
+   char *checkpoint; /* checkpoint file written during the run */
+   int interval;     /* generations between checkpoints, 0 end */
+   char *resume;     /* checkpoint file to resume from         */
+   char *rule;       /* rulestring, B3/S23 unless -l is given  */
+   int runs;         /* immigration runs of an ensemble, or 0  */
+   char *profile;    /* where -o sends phase timings, or NULL  */
+   int frame_rate;   /* frames a second, 0 for every generation */
+   int turbo;        /* generations stepped before any frame    */
+   char *image;      /* PPM frames of a headless run, or NULL   */
+   char *delta;      /* delta log of a headless run, or NULL    */
+};
+typedef struct _run_options run_options;
+struct _ensemble_result {
+   int outcome;           /* an ensemble_outcome                  */
+   int generation;        /* the run ended at                     */
+};
+typedef struct _ensemble_result ensemble_result;
+struct _ensemble {
+   /* the runs of an ensemble, handed out one at a time to threads */
+   int runs;
+   int next_run;          /* the first run not yet taken          */
+   pthread_mutex_t lock;
+   ensemble_result *results;
+};
+typedef struct _ensemble ensemble;
 
 /* IMMIGRATION LIFE FUNCS */
 void immigration(void);
-void im_init_board(square board[][COLUMNS]);
-void im_random_fill(square board[][COLUMNS], choice version);
-void im_print_board(square board[][COLUMNS], choice version);
-square im_read_toroidal(square board[][COLUMNS], cell row, cell col);
-int im_sum_state(square board[][COLUMNS], cell row, cell col);
-int im_sum_color_red(square board[][COLUMNS], cell row, cell col);
-int im_sum_color_yellow(square board[][COLUMNS], cell row, cell col);
-void im_gen_next_board(square current[][COLUMNS], square next[][COLUMNS]);
-int im_next_cell_color(int sum_yellow, int sum_red);
-void im_switchpointers(square **p1, square **p2);
-bool im_iscopy(square board1[][COLUMNS], square board2[][COLUMNS]);
-int cnt_yellow(square board[][COLUMNS]);
-int cnt_red(square board[][COLUMNS]);
+void im_init_board(im_board *board);
+void im_random_fill(im_board *board, uint64_t seed);
+void im_print_board(frame *screen, im_board *board, choice version);
+bool im_gen_rows(im_board *current, im_board *next, int first, int last,
+                 int first_word, int last_word, im_census *census);
+static ALWAYS_INLINE bool im_gen_words(im_board *current, im_board *next,
+                                       int first, int last, int first_word,
+                                       int last_word, im_census *census,
+                                       int life);
+void im_switchpointers(im_board **p1, im_board **p2);
+bool im_iscopy(im_board *board1, im_board *board2);
 /* COLOR LIFE FUNCS */
 void advanced_life();
-void im_next_colorstate_board(square current[][COLUMNS], square next[][COLUMNS]);
+bool im_colorstate_rows(im_board *current, im_board *next, int first,
+                        int last, int first_word, int last_word,
+                        im_census *census);
+static ALWAYS_INLINE bool im_colorstate_words(im_board *current,
+                                              im_board *next, int first,
+                                              int last, int first_word,
+                                              int last_word,
+                                              im_census *census, int life);
+/* BIT PLANE FUNCTIONS */
+bool im_bit(bitword *plane, int row, int col);
+int im_popcount(bitword word);
+color im_color_at(im_board *board, int row, int col);
+static ALWAYS_INLINE bitword im_west(bitword *row, int w);
+static ALWAYS_INLINE bitword im_east(bitword *row, int w);
+static ALWAYS_INLINE void im_neighbours(bitword *up, bitword *mid,
+                                        bitword *down, int w,
+                                        bitword *n);
+static ALWAYS_INLINE void im_add_neighbours(bitword *n, bitword *ones,
+                                            bitword *twos, bitword *fours,
+                                            bitword *eights, bitword *many);
+/* ACTIVE TILE FUNCTIONS */
+tile_flag *im_alloc_tiles(arena *a);
+bool im_tile_active(tile_flag *changed, int tile_row, int tile_col);
+void im_tile_rows(rows_func rows, im_board *current, im_board *next,
+                  tile_flag *changed, tile_flag *next_changed, int first,
+                  int last, band_share *share);
+void im_census_tiles(im_board *board);
+void im_add_census(im_census *total, im_census *part);
+void im_set_stats(im_board *board, im_census *total);
+/* WORKER POOL FUNCTIONS */
+void im_step(rows_func rows, im_board *current, im_board *next);
+void im_step_tiles(rows_func rows, im_board *current, im_board *next,
+                   tile_map *map);
+void job_create(pool_job *j, int threads);
+void job_destroy(pool_job *j);
+void pool_run(worker_pool *p, rows_func rows, im_board *current,
+              im_board *next, int generations);
+void pool_fill(worker_pool *p, im_board *board, uint64_t seed);
+void pool_work(worker_pool *p, int index);
+/* CYCLE DETECTION FUNCTIONS */
+uint64_t im_hash_rows(im_board *board, int first, int last);
+void im_copy_board(im_board *to, im_board *from);
+void cycle_create(cycle_ring *ring, int size, im_board *first);
+void cycle_destroy(cycle_ring *ring);
+int cycle_check(cycle_ring *ring, im_board *board);
+/* RANDOM FILL FUNCTIONS */
+void im_fill_rows(im_board *board, uint64_t seed, int first, int last);
+/* HEADLESS AND BENCHMARK FUNCTIONS */
+void print_usage(char *name);
+void im_setup(arena *a, im_board *boarda, im_board *boardb,
+              choice version);
+void im_refill(im_board *boarda, im_board *boardb, tile_map *map,
+               uint64_t seed);
+int im_run(choice version, im_board **current, im_board **next,
+           int generations);
+void headless(void);
+void benchmark(void);
+void bench_case(int rows, int columns, int density, choice version);
+/* ENSEMBLE FUNCTIONS */
+void ensemble_run(int threads);
+void *ensemble_thread(void *arg);
+void ensemble_play(im_board *boarda, im_board *boardb, tile_map *map,
+                   uint64_t seed, ensemble_result *result);
+void ensemble_report(ensemble *e, int threads, double seconds);
+void ensemble_interval(int hits, int runs, double *low, double *high);
+double ensemble_sqrt(double x);
+int ensemble_compare(const void *a, const void *b);
+/* CHECKPOINT FUNCTIONS */
+size_t checkpoint_plane_bytes(void);
+int checkpoint_planes(choice version);
+void checkpoint_tick(checkpoint *ck, im_board *board);
+void checkpoint_post(checkpoint *ck, im_board *board);
+void checkpoint_open(checkpoint_map *map, char *path);
+void checkpoint_restore(im_board *board, checkpoint_map *map);
+/* BOARD STORAGE FUNCTIONS */
+bool set_dimensions(int rows, int columns);
+size_t im_board_bytes(choice version);
+size_t im_arena_bytes(choice version);
+void im_alloc_board(arena *a, im_board *board, choice version);
+/* FRAME EXPORT FUNCTIONS */
+void export_open(frame_export *x, char *image, char *delta, choice version);
+void export_frame(frame_export *x, im_board *board);
+void export_image(frame_export *x, im_board *board);
+void export_delta(frame_export *x, im_board *board);
+void export_close(frame_export *x);
 /* HELPER FUNCTIONS */
 void print_intro(void); 
-void set_color(int color_choice); 
-void clear_console(void);
-int console_width(void); 
-void position_text(int offset);
 choice get_choice(void); 
 
-int main(void)
+dimensions dims;
+worker_pool *pool = NULL;
+pool_job job;
+tile_map tiles;
+char *profile_phase_names[] = {"step", "compare", "checkpoint", "render",
+                               "sleep"};
+char *profile_counter_names[] = {"squares_evaluated", "tiles_skipped",
+                                 "bytes_written"};
+/* RGB of each color, as a VGA terminal shows it */
+unsigned char color_rgb[][3] = {{255, 85, 85}, {255, 255, 85},
+                                {85, 85, 255}, {0, 0, 170},
+                                {170, 170, 170}, {85, 255, 255},
+                                {85, 255, 85}, {255, 85, 255}};
+run_options options = {false, GENERATIONS, DENSITY, 0, immigration_life,
+                       MAX_PERIOD, NULL, 0, NULL, RULE, 0, NULL, 0, 0,
+                       NULL, NULL};
+checkpoint_map resumed;
+
+int main(int argc, char *argv[])
 {
    choice start_state; 
-   srand(time(NULL));
-   print_intro();
-
-   start_state = get_choice(); 
+   int rows = DEFAULT_ROWS, columns = DEFAULT_COLUMNS, threads = 1;
+   int i, args;
+   bool bench = false;
+   char flag, *value = NULL;
+   worker_pool workers;
 
-   if (start_state == immigration_life){
-      immigration();
+   /* options come first, each on its own: -n -g 100 ... */
+   options.seed = time(NULL);
+   for (i = 1; i < argc && argv[i][0] == '-'; i++){
+      flag = strlen(argv[i]) == 2 ? argv[i][1] : '?';
+      if (strchr("mgdspcirleovuaj", flag) != NULL){
+         if (++i == argc){
+            flag = '?';
+         } else {
+            value = argv[i];
+         }
+      }
+      switch (flag){
+      case 'n':
+         options.headless = true;
+         break;
+      case 'b':
+         bench = true;
+         break;
+      case 'm':
+         options.mode = atoi(value);
+         break;
+      case 'g':
+         options.generations = atoi(value);
+         break;
+      case 'd':
+         options.density = atoi(value);
+         break;
+      case 's':
+         options.seed = strtoul(value, NULL, 10);
+         break;
+      case 'p':
+         options.max_period = atoi(value);
+         break;
+      case 'c':
+         options.checkpoint = value;
+         break;
+      case 'i':
+         options.interval = atoi(value);
+         break;
+      case 'r':
+         options.resume = value;
+         break;
+      case 'l':
+         options.rule = value;
+         break;
+      case 'e':
+         options.runs = atoi(value);
+         break;
+      case 'o':
+         options.profile = value;
+         break;
+      case 'v':
+         options.frame_rate = atoi(value);
+         break;
+      case 'u':
+         options.turbo = atoi(value);
+         break;
+      case 'a':
+         options.image = value;
+         break;
+      case 'j':
+         options.delta = value;
+         break;
+      default:
+         print_usage(argv[0]);
+         return 1;
+      }
+   }
+   args = argc - i;
+   if (args == 2 || args == 3){
+      rows = atoi(argv[i]);
+      columns = atoi(argv[i + 1]);
+      if (args == 3){
+         threads = atoi(argv[i + 2]);
+      }
+   } else if (args != 0){
+      print_usage(argv[0]);
+      return 1;
+   }
+   if (options.runs > 0 && args < 3){
+      /* an ensemble plays its runs on every core unless told */
+      threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+      threads = threads > 0 ? threads : 1;
+   }
+   if (!rule_parse(&rule, options.rule)){
+      printf("***ERROR: invalid rule %s***\n", options.rule);
+      return 1;
+   }
+   if (options.resume != NULL && (bench || options.runs > 0)){
+      printf("***ERROR: -r resumes a single run, not -b or -e***\n");
+      return 1;
+   }
+   /* a checkpoint brings its own size, version, rule, seed and */
+   /* generation                                                */
+   resumed.base = NULL;
+   if (options.resume != NULL){
+      checkpoint_open(&resumed, options.resume);
+      rows = resumed.header->rows;
+      columns = resumed.header->columns;
+      options.mode = resumed.header->mode;
+      options.seed = (unsigned)resumed.header->seed;
+      rule_compile(&rule, resumed.header->birth, resumed.header->survive);
+   }
+   if (!set_dimensions(rows, columns) || threads < 1){
+      printf("***ERROR: invalid board size or thread count***\n");
+      return 1;
+   }
+   if (options.generations < 0 || options.density < 1
+       || (options.mode != immigration_life && options.mode != adv_life)
+       || options.max_period < 0 || options.interval < 0
+       || options.runs < 0){
+      printf("***ERROR: invalid generations, density, mode, period, "
+             "interval or runs***\n");
+      return 1;
+   }
+   if (options.frame_rate < 0 || options.turbo < 0){
+      printf("***ERROR: invalid frame rate or turbo generations***\n");
+      return 1;
+   }
+   if (options.runs > 0 && options.mode != immigration_life){
+      printf("***ERROR: an ensemble plays immigration life only***\n");
+      return 1;
+   }
+   if ((options.image != NULL || options.delta != NULL)
+       && (!options.headless || bench || options.runs > 0
+           || (options.image != NULL && options.delta != NULL
+               && strcmp(options.image, "-") == 0
+               && strcmp(options.delta, "-") == 0))){
+      printf("***ERROR: -a and -j write a headless run, and only one "
+             "to -***\n");
+      return 1;
+   }
+   if (options.profile != NULL
+       && (!PROFILE || options.headless || bench || options.runs > 0)){
+      printf("***ERROR: -o profiles a displayed run of a build with "
+             "-DPROFILE=1***\n");
+      return 1;
+   }
+   /* an ensemble's threads play whole runs, not bands of one */
+   if (threads > 1 && (options.runs == 0 || bench)){
+      job_create(&job, threads);
+      pool_create(&workers, threads, pool_work, &job);
+      pool = &workers;
+   }
+   if (bench){
+      benchmark();
+   } else if (options.runs > 0){
+      ensemble_run(threads);
+   } else if (options.headless){
+      headless();
    } else {
-      advanced_life();
+      print_intro();
+
+      /* a checkpoint needs no choice of version */
+      start_state = resumed.base != NULL ? options.mode : get_choice();
+
+      if (start_state == immigration_life){
+         immigration();
+      } else {
+         advanced_life();
+      }
+   }
+   if (pool != NULL){
+      pool_destroy(pool);
+      job_destroy(&job);
    }
+   checkpoint_close(&resumed);
 
    return 0; 
 }
@@ -107,399 +526,1616 @@ int main(void)
 /* The color of each newly born cells is determined */ 
 /* by the majority color of the parent cells.       */
 /* Over time, one color may come to dominate.       */
-/* The color and sum values for each are stored     */ 
-/* in a structure called 'square'                   */
+/* The state and color of the squares are stored   */ 
+/* as bit planes in an 'im_board'                   */
 /****************************************************/
 void immigration(void)
 {
-   int i = 0;
+   int i = 0, period = 0;
    choice version = immigration_life; 
-   square boarda[ROWS][COLUMNS];
-   square boardb[ROWS][COLUMNS];
-   timespec tim, tim2;
-   tim.tv_sec = 0;
-   tim.tv_nsec = 250000000;
+   arena boards;
+   im_board boarda, boardb, *latest = &boarda, *next = &boardb;
+   cycle_ring ring;
+   checkpoint saver;
+   frame screen;
+   frame_pace pace;
    
-   im_init_board(boarda);
-   im_init_board(boardb);
-   im_random_fill(boarda, version);
+   im_setup(&boards, &boarda, &boardb, version);
 
-   while (i++ < GENERATIONS){
-      clear_console();
-      im_print_board(boarda, version);
-      nanosleep(&tim, &tim2);
-      im_gen_next_board(boarda, boardb);
+   frame_create(&screen, dims.rows, dims.columns);
+   cycle_create(&ring, options.max_period, &boarda);
+   checkpoint_start(&saver, options.checkpoint, options.interval,
+                    checkpoint_planes(version) * checkpoint_plane_bytes());
+   profile_open(options.profile);
+   pace_start(&pace, options.frame_rate, options.turbo);
+   while (i++ < options.generations && period == 0){
+      if (pace_due(&pace)){
+         profile_enter(phase_render);
+         im_print_board(&screen, latest, version);
+         profile_enter(phase_sleep);
+         pace_wait(&pace);
+      }
+      profile_enter(phase_step);
+      im_step(im_gen_rows, latest, next);
+      next = latest;
+      latest = latest == &boarda ? &boardb : &boarda;
+      profile_enter(phase_checkpoint);
+      checkpoint_tick(&saver, latest);
+      profile_enter(phase_compare);
+      period = cycle_check(&ring, latest);
+      profile_generation(latest->stats.generation);
+   }
+   /* the last board is shown however many frames were skipped */
+   profile_enter(phase_render);
+   im_print_board(&screen, latest, version);
+   profile_close(latest->stats.generation);
+   if (period != 0){
+      printf("PERIOD: %d\n", period);
+   }
+   checkpoint_post(&saver, latest);
+   checkpoint_stop(&saver);
+   cycle_destroy(&ring);
+   frame_destroy(&screen);
+   arena_destroy(&boards);
+}
 
-      clear_console();
-      im_print_board(boardb, version);
-      nanosleep(&tim, &tim2);
-      im_gen_next_board(boardb, boarda);
+bool im_gen_rows(im_board *current, im_board *next, int first, int last,
+                 int first_word, int last_word, im_census *census)
+{
+   /* next generation for rows first .. last-1 and words           */
+   /* first_word .. last_word-1 only, 64 squares at a time. Returns */
+   /* true if next held anything different there, and adds what it  */
+   /* made to census                                                */
+   if (rule.life){
+      return im_gen_words(current, next, first, last, first_word,
+                          last_word, census, true);
+   }
+   return im_gen_words(current, next, first, last, first_word, last_word,
+                       census, false);
+}
 
-      if (im_iscopy(boarda,boardb)){
-         exit(0); 
+static ALWAYS_INLINE bool im_gen_words(im_board *current, im_board *next,
+                                       int first, int last, int first_word,
+                                       int last_word, im_census *census,
+                                       int life)
+{
+   /* The live and the yellow neighbours are each added with full   */
+   /* adders in the same pass. Under B3/S23 a square born has       */
+   /* exactly 3 live parents, so the majority color rule makes it   */
+   /* yellow when 2 or more of them are.                            */
+   /* Under other rules the yellow parents are compared with the    */
+   /* live ones: yellow when twice their count is more              */
+   int r, w, k;
+   bitword *up, *mid, *down, *c_up, *c_mid, *c_down, *out, *c_out;
+   bitword n[8], y[8], ones, twos, fours, eights, many;
+   bitword y_ones, y_twos, y_fours, y_eights, y_many, more, same;
+   bitword next_alive, next_colour, moved = 0;
+   bitword mask = ~(bitword)0 >> (WORD_BITS - dims.last_bits);
+   for (r = first; r < last; r++){
+      up = PLANE_ROW(current->alive, r == 0 ? dims.rows - 1 : r - 1);
+      mid = PLANE_ROW(current->alive, r);
+      down = PLANE_ROW(current->alive, r == dims.rows - 1 ? 0 : r + 1);
+      c_up = PLANE_ROW(current->colour, r == 0 ? dims.rows - 1 : r - 1);
+      c_mid = PLANE_ROW(current->colour, r);
+      c_down = PLANE_ROW(current->colour, r == dims.rows - 1 ? 0 : r + 1);
+      out = PLANE_ROW(next->alive, r);
+      c_out = PLANE_ROW(next->colour, r);
+      for (w = first_word; w < last_word; w++){
+         im_neighbours(up, mid, down, w, n);
+         im_neighbours(c_up, c_mid, c_down, w, y);
+         for (k = 0; k < 8; k++){
+            y[k] &= n[k];
+         }
+         im_add_neighbours(n, &ones, &twos, &fours, &eights, &many);
+         im_add_neighbours(y, &y_ones, &y_twos, &y_fours, &y_eights,
+                           &y_many);
+         if (life){
+            /* born with 3, survives with 2 or 3 */
+            next_alive = twos & ~many & (ones | mid[w]);
+            more = y_twos | y_many;
+         } else {
+            next_alive = rule_word(ones, twos, fours, eights, mid[w]);
+            /* twice the yellow count against the live one, digit by */
+            /* digit from the top                                    */
+            more = y_eights;
+            same = ~y_eights;
+            more |= same & y_fours & ~eights;
+            same &= ~(y_fours ^ eights);
+            more |= same & y_twos & ~fours;
+            same &= ~(y_twos ^ fours);
+            more |= same & y_ones & ~twos;
+         }
+         /* survivors keep their color, the born take the majority's */
+         next_colour = (next_alive & c_mid[w])
+                       | (next_alive & ~mid[w] & more);
+         if (w == dims.row_words - 1){
+            next_alive &= mask;
+            next_colour &= mask;
+         }
+         moved |= (out[w] ^ next_alive) | (c_out[w] ^ next_colour);
+         out[w] = next_alive;
+         c_out[w] = next_colour;
+         census->population += im_popcount(next_alive);
+         census->births += im_popcount(next_alive & ~mid[w]);
+         census->deaths += im_popcount(mid[w] & ~next_alive);
+         census->yellow += im_popcount(next_colour);
       }
    }
+   return moved != 0;
 }
 
-state next_cell_state(int sum, state current_state)
+void im_init_board(im_board *board)
 {
-   if (sum == set_alive) {
-      return alive;
+   /* all dead: every plane cleared */
+   size_t bytes = (size_t)dims.rows * dims.row_words * sizeof(bitword);
+   memset(board->alive, 0, bytes);
+   if (board->version == immigration_life){
+      memset(board->colour, 0, bytes);
+   } else {
+      memset(board->age_lo, 0, bytes);
+      memset(board->age_hi, 0, bytes);
    }
-   if (sum == hold) {
-      return current_state;
+}
+
+void im_random_fill(im_board *board, uint64_t seed)
+{
+   /* a color life square starts at age 0 (cyan), already clear. */
+   /* The bands of the pool fill their own rows at once           */
+   if (pool != NULL){
+      pool_fill(pool, board, seed);
+   } else {
+      im_fill_rows(board, seed, 0, dims.rows);
    }
-   return dead; 
 }
 
-void im_gen_next_board(square current[][COLUMNS], square next[][COLUMNS])
+void im_print_board(frame *screen, im_board *board, choice version)
 {
-   /* Generates the next board based on the previous board */
    int r, c;
-   int sum_state, sum_color_red, sum_color_yellow; 
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         sum_state = im_sum_state(current, r, c);
-         sum_color_red = im_sum_color_red(current, r, c);
-         sum_color_yellow = im_sum_color_yellow(current, r, c);
-         /* set next cell state based on previous cell state */
-         next[r][c].cell_state = next_cell_state(sum_state, 
-                         current[r][c].cell_state);
-         /* set next cell color to previous cell color */
-         next[r][c].cell_color = current[r][c].cell_color;
-         /* if cell dies set color to death color */
-         if(next[r][c].cell_state == dead){   
-            next[r][c].cell_color = mild_blue;
-         } 
-         /* if cell is born set color based on surrounding live cells */     
-         if(current[r][c].cell_state == dead && next[r][c].cell_state == alive){
-            next[r][c].cell_color = im_next_cell_color(sum_color_yellow, sum_color_red);
-         }
+   char line[32];
+   frame_begin(screen);
+   for (r = 0; r < dims.rows; r++){
+      for (c = 0; c < dims.columns; c++){
+         frame_square(screen, r, c, im_color_at(board, r, c));
       }
    }
+   if (version == immigration_life){
+      sprintf(line, "RED %d ", board->stats.red);
+      frame_text(screen, dims.rows + 2, screen->margin + 1, red, line);
+      sprintf(line, "YELLOW %d ", board->stats.yellow);
+      frame_text(screen, dims.rows + 2, screen->column, yellow, line);
+   }
+   frame_flush(screen);
 }
 
-int im_next_cell_color(int sum_yellow, int sum_red)
+void im_switchpointers(im_board **p1, im_board **p2)
 {
-   /* The next cell color is determined by the majority color */
-   if (sum_yellow > sum_red){
-      return yellow;
+   im_board *tmp;
+   tmp = *p1;
+   *p1 = *p2;
+   *p2 = tmp;
+}
+
+bool im_iscopy(im_board *board1, im_board *board2)
+{
+   /* every plane the version uses, so the colors must match too */
+   size_t bytes = (size_t)dims.rows * dims.row_words * sizeof(bitword);
+   if (memcmp(board1->alive, board2->alive, bytes) != 0){
+      return false;
+   }
+   if (board1->version == immigration_life){
+      return memcmp(board1->colour, board2->colour, bytes) == 0;
    }
-   return red; 
+   return memcmp(board1->age_lo, board2->age_lo, bytes) == 0
+          && memcmp(board1->age_hi, board2->age_hi, bytes) == 0;
 }
 
-int im_sum_state(square board[][COLUMNS], cell row, cell col)
+/************************************************/
+/*    ADVANCED COLOR-STATE LIFE FUNCTIONS       */
+/************************************************/
+/* This version of life uses color to show the  */
+/* lifespan of the cells:                       */
+/*             birth = cyan (light blue)        */
+/*             child = green                    */
+/*             adult = yellow                   */
+/************************************************/
+void advanced_life(void)
 {
-   /* counts number of live cells within a given cell's 8 neighbors */
-   /*                   s1, s2, s3                                    */
-   /*                   s4, x , s4,                                   */
-   /*                   s5, s6, s7                                    */
-   int r, c, sum = 0;
-   square temp;  
-   for (r = row-1; r <= row+1; r++){
-      for (c = col-1; c <= col+1; c++){
-         temp = im_read_toroidal(board, r, c);
-         if (temp.cell_state == alive){
-            sum++;
-         }
+   int i = 0, period = 0;
+   choice version = adv_life; 
+   arena boards;
+   im_board boarda, boardb, *latest = &boarda, *next = &boardb;
+   cycle_ring ring;
+   checkpoint saver;
+   frame screen;
+   frame_pace pace;
+   
+   im_setup(&boards, &boarda, &boardb, version);
+
+   frame_create(&screen, dims.rows, dims.columns);
+   cycle_create(&ring, options.max_period, &boarda);
+   checkpoint_start(&saver, options.checkpoint, options.interval,
+                    checkpoint_planes(version) * checkpoint_plane_bytes());
+   profile_open(options.profile);
+   pace_start(&pace, options.frame_rate, options.turbo);
+   while (i++ < options.generations && period == 0){
+      if (pace_due(&pace)){
+         profile_enter(phase_render);
+         im_print_board(&screen, latest, version);
+         profile_enter(phase_sleep);
+         pace_wait(&pace);
       }
-   }   
-   return sum; 
+      profile_enter(phase_step);
+      im_step(im_colorstate_rows, latest, next);
+      next = latest;
+      latest = latest == &boarda ? &boardb : &boarda;
+      profile_enter(phase_checkpoint);
+      checkpoint_tick(&saver, latest);
+      profile_enter(phase_compare);
+      period = cycle_check(&ring, latest);
+      profile_generation(latest->stats.generation);
+   }
+   /* the last board is shown however many frames were skipped */
+   profile_enter(phase_render);
+   im_print_board(&screen, latest, version);
+   profile_close(latest->stats.generation);
+   if (period != 0){
+      printf("PERIOD: %d\n", period);
+   }
+   checkpoint_post(&saver, latest);
+   checkpoint_stop(&saver);
+   cycle_destroy(&ring);
+   frame_destroy(&screen);
+   arena_destroy(&boards);
+}
+
+bool im_colorstate_rows(im_board *current, im_board *next, int first,
+                        int last, int first_word, int last_word,
+                        im_census *census)
+{
+   /* next color state for rows first .. last-1 and words          */
+   /* first_word .. last_word-1 only, 64 squares at a time. Returns */
+   /* true if next held anything different there, and adds what it  */
+   /* made to census                                                */
+   if (rule.life){
+      return im_colorstate_words(current, next, first, last, first_word,
+                                 last_word, census, true);
+   }
+   return im_colorstate_words(current, next, first, last, first_word,
+                              last_word, census, false);
 }
 
-int im_sum_color_yellow(square board[][COLUMNS], cell row, cell col)
+static ALWAYS_INLINE bool im_colorstate_words(im_board *current,
+                                              im_board *next, int first,
+                                              int last, int first_word,
+                                              int last_word,
+                                              im_census *census, int life)
 {
-   /* counts number of yellow cells within a given cell's 8 neighbors */
-   int r, c, sum = 0;
-   square temp;  
-   for (r = row-1; r <= row+1; r++){
-      for (c = col-1; c <= col+1; c++){
-         temp = im_read_toroidal(board, r, c);
-         if (temp.cell_color == yellow){
-            sum++;
+   /* A square born is age 0 (cyan), a survivor ages by one up to 2 */
+   /* (yellow) and the dead have no age                              */
+   int r, w;
+   bitword *up, *mid, *down, *out, *lo, *hi, *lo_out, *hi_out;
+   bitword n[8], ones, twos, fours, eights, many, survive, older;
+   bitword next_alive, next_lo, next_hi, moved = 0;
+   bitword mask = ~(bitword)0 >> (WORD_BITS - dims.last_bits);
+   for (r = first; r < last; r++){
+      up = PLANE_ROW(current->alive, r == 0 ? dims.rows - 1 : r - 1);
+      mid = PLANE_ROW(current->alive, r);
+      down = PLANE_ROW(current->alive, r == dims.rows - 1 ? 0 : r + 1);
+      lo = PLANE_ROW(current->age_lo, r);
+      hi = PLANE_ROW(current->age_hi, r);
+      out = PLANE_ROW(next->alive, r);
+      lo_out = PLANE_ROW(next->age_lo, r);
+      hi_out = PLANE_ROW(next->age_hi, r);
+      for (w = first_word; w < last_word; w++){
+         im_neighbours(up, mid, down, w, n);
+         im_add_neighbours(n, &ones, &twos, &fours, &eights, &many);
+         if (life){
+            next_alive = twos & ~many & (ones | mid[w]);
+         } else {
+            next_alive = rule_word(ones, twos, fours, eights, mid[w]);
          }
+         if (w == dims.row_words - 1){
+            next_alive &= mask;
+         }
+         /* cyan goes to green, green and yellow go to yellow */
+         survive = next_alive & mid[w];
+         older = lo[w] | hi[w];
+         next_lo = survive & ~older;
+         next_hi = survive & older;
+         moved |= (out[w] ^ next_alive) | (lo_out[w] ^ next_lo)
+                  | (hi_out[w] ^ next_hi);
+         out[w] = next_alive;
+         lo_out[w] = next_lo;
+         hi_out[w] = next_hi;
+         census->population += im_popcount(next_alive);
+         census->births += im_popcount(next_alive & ~mid[w]);
+         census->deaths += im_popcount(mid[w] & ~next_alive);
+         census->yellow += im_popcount(next_hi);
+         census->green += im_popcount(next_lo);
       }
-   }   
-   return sum; 
+   }
+   return moved != 0;
 }
 
-int im_sum_color_red(square board[][COLUMNS], cell row, cell col)
+/*************************************************/
+/*             BIT PLANE FUNCTIONS               */
+/*************************************************/
+/* A board is kept as planes of single bits, 64  */
+/* squares to a word, so the rules run on whole  */
+/* words. The bits past the last column of a row */
+/* are always clear.                             */
+/*************************************************/
+bool im_bit(bitword *plane, int row, int col)
 {
-   /* counts number of red cells within a given cell's 8 neighbors */
-   int r, c, sum = 0;
-   square temp;  
-   for (r = row-1; r <= row+1; r++){
-      for (c = col-1; c <= col+1; c++){
-         temp = im_read_toroidal(board, r, c);
-         if (temp.cell_color == red){
-            sum++;
+   return (PLANE_ROW(plane, row)[col / WORD_BITS] >> (col % WORD_BITS)) & 1;
+}
+
+int im_popcount(bitword word)
+{
+#ifdef __GNUC__
+   return __builtin_popcountll(word);
+#else
+   int count = 0;
+   for (; word != 0; word &= word - 1){
+      count++;
+   }
+   return count;
+#endif
+}
+
+color im_color_at(im_board *board, int row, int col)
+{
+   /* the color a square is drawn in */
+   static const color ages[] = {cyan, green, yellow};
+   if (!im_bit(board->alive, row, col)){
+      return mild_blue;
+   }
+   if (board->version == immigration_life){
+      return im_bit(board->colour, row, col) ? yellow : red;
+   }
+   return ages[im_bit(board->age_lo, row, col)
+               + 2 * im_bit(board->age_hi, row, col)];
+}
+
+static ALWAYS_INLINE bitword im_west(bitword *row, int w)
+{
+   /* each bit replaced by its west neighbour's, wrapping the row */
+   bitword in;
+   if (w > 0){
+      in = row[w - 1] >> (WORD_BITS - 1);
+   } else {
+      in = row[dims.row_words - 1] >> (dims.last_bits - 1);
+   }
+   return (row[w] << 1) | (in & 1);
+}
+
+static ALWAYS_INLINE bitword im_east(bitword *row, int w)
+{
+   /* each bit replaced by its east neighbour's, wrapping the row */
+   bitword in, word = row[w] >> 1;
+   in = row[w == dims.row_words - 1 ? 0 : w + 1] & 1;
+   if (w == dims.row_words - 1){
+      word |= in << (dims.last_bits - 1);
+   } else {
+      word |= in << (WORD_BITS - 1);
+   }
+   return word;
+}
+
+static ALWAYS_INLINE void im_neighbours(bitword *up, bitword *mid,
+                                        bitword *down, int w,
+                                        bitword *n)
+{
+   /* the 8 neighbour planes of word w */
+   n[0] = im_west(up, w);
+   n[1] = up[w];
+   n[2] = im_east(up, w);
+   n[3] = im_west(mid, w);
+   n[4] = im_east(mid, w);
+   n[5] = im_west(down, w);
+   n[6] = down[w];
+   n[7] = im_east(down, w);
+}
+
+static ALWAYS_INLINE void im_add_neighbours(bitword *n, bitword *ones,
+                                            bitword *twos, bitword *fours,
+                                            bitword *eights, bitword *many)
+{
+   /* adds the 8 neighbour planes bit by bit: the count's 1s, 2s, 4s */
+   /* and 8s bits, and many where it is 4 or more. What a caller     */
+   /* does not use is dropped once this is inlined                   */
+   bitword a0, a1, b0, b1, m0, m1, carry, x, xc, y, yc;
+   a0 = n[0] ^ n[1] ^ n[2];
+   a1 = (n[0] & n[1]) | (n[2] & (n[0] ^ n[1]));
+   b0 = n[5] ^ n[6] ^ n[7];
+   b1 = (n[5] & n[6]) | (n[7] & (n[5] ^ n[6]));
+   m0 = n[3] ^ n[4];
+   m1 = n[3] & n[4];
+   *ones = a0 ^ b0 ^ m0;
+   carry = (a0 & b0) | (m0 & (a0 ^ b0));
+   x = a1 ^ b1;
+   xc = a1 & b1;
+   y = m1 ^ carry;
+   yc = m1 & carry;
+   *twos = x ^ y;
+   *many = (x & y) | xc | yc;
+   /* of x & y, xc and yc only xc and yc are ever set together */
+   *fours = (x & y) ^ xc ^ yc;
+   *eights = xc & yc;
+}
+
+/*************************************************/
+/*            ACTIVE TILE FUNCTIONS              */
+/*************************************************/
+/* The board is cut into tiles TILE_SIZE rows by */
+/* one word, each flagged if it differs from two */
+/* boards ago. The boards are swapped every      */
+/* generation, so next still holds the one that  */
+/* came before current. A square's next value    */
+/* only depends on its neighbours, so a tile     */
+/* whose flags all around are clear comes out as */
+/* next already has it and is skipped outright.  */
+/* Still lifes and blinkers both drop out, and   */
+/* the work then follows activity rather than    */
+/* board area.                                   */
+/*************************************************/
+tile_flag *im_alloc_tiles(arena *a)
+{
+   /* a filled board has no real generation before it, so every */
+   /* tile is done for the first two steps                       */
+   size_t i, count = (size_t)dims.tile_rows * dims.tile_columns;
+   tile_flag *flags = arena_alloc(a, count);
+   for (i = 0; i < count; i++){
+      flags[i] = tile_filled;
+   }
+   return flags;
+}
+
+bool im_tile_active(tile_flag *changed, int tile_row, int tile_col)
+{
+   /* true if the tile or one of its 8 neighbours (wrapping) changed */
+   int r, c, tr, tc;
+   for (r = tile_row-1; r <= tile_row+1; r++){
+      tr = (r + dims.tile_rows) % dims.tile_rows;
+      for (c = tile_col-1; c <= tile_col+1; c++){
+         tc = (c + dims.tile_columns) % dims.tile_columns;
+         if (changed[tr * dims.tile_columns + tc]){
+            return true;
          }
       }
-   }   
-   return sum; 
-}
-
-square im_read_toroidal(square board[][COLUMNS], cell row, cell col)
-{
-  /* wraps around the board Left-Right, Top-Bottom */
-  /* returns the correct struct square             */
-  int r = row % ROWS;
-  int c = col % COLUMNS;
-  if (row < 0){
-     r = ROWS - 1;  
-  }
-  if (col < 0){
-     c = COLUMNS - 1; 
-  }
-  return board[r][c];
-} 
-
-void im_init_board(square board[][COLUMNS])
-{
-   int i, j;
-   for (i = 0; i < ROWS; i++){
-      for (j = 0; j < COLUMNS; j++){
-         board[i][j].cell_state = dead;
-         board[i][j].cell_color = mild_blue; 
+   }
+   return false;
+}
+
+void im_tile_rows(rows_func rows, im_board *current, im_board *next,
+                  tile_flag *changed, tile_flag *next_changed, int first,
+                  int last, band_share *share)
+{
+   /* runs rows over the active tiles that start in rows first .. last-1 */
+   /* and records which of them differ from what next held before. A    */
+   /* skipped tile keeps next's census of it, with the births and       */
+   /* deaths of the step that made current swapped, as it undoes that   */
+   /* step. The rows are then hashed while in cache, when cycles are    */
+   /* looked for                                                        */
+   int tr, tc, t, row_end;
+   bool moved;
+   memset(&share->census, 0, sizeof(im_census));
+   if (PROFILE){
+      share->evaluated = share->skipped = 0;
+   }
+   for (tr = first / TILE_SIZE; tr * TILE_SIZE < last; tr++){
+      row_end = (tr + 1) * TILE_SIZE < dims.rows ? (tr + 1) * TILE_SIZE
+                                                 : dims.rows;
+      for (tc = 0; tc < dims.tile_columns; tc++){
+         t = tr * dims.tile_columns + tc;
+         moved = changed[t] == tile_filled;
+         if (im_tile_active(changed, tr, tc)){
+            memset(&next->census[t], 0, sizeof(im_census));
+            moved |= rows(current, next, tr * TILE_SIZE, row_end, tc,
+                          tc + 1, &next->census[t]);
+            if (PROFILE){
+               share->evaluated += (int64_t)(row_end - tr * TILE_SIZE)
+                                   * ((tc + 1) * WORD_BITS < dims.columns
+                                      ? WORD_BITS
+                                      : dims.columns - tc * WORD_BITS);
+            }
+         } else {
+            next->census[t].births = current->census[t].deaths;
+            next->census[t].deaths = current->census[t].births;
+            if (PROFILE){
+               share->skipped++;
+            }
+         }
+         im_add_census(&share->census, &next->census[t]);
+         next_changed[t] = moved ? tile_changed : tile_still;
       }
    }
+   share->hash = options.max_period > 0 ? im_hash_rows(next, first, last)
+                                        : 0;
 }
 
-void im_random_fill(square board[][COLUMNS], choice version)
+void im_census_tiles(im_board *board)
 {
-   int r, c;
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         if (rand() % DENSITY == 0){
-            board[r][c].cell_state = alive;
-            if (version == immigration_life){ 
-               if (rand() % COLOR_DENSITY == 0){
-                  board[r][c].cell_color = red;
-               } else {
-                  board[r][c].cell_color = yellow;
-               }
+   /* counts every tile of a board filled by hand, which has no */
+   /* births or deaths, and sets the board's stats from them     */
+   im_census total, *tile;
+   bitword alive;
+   int tr, tc, r, row_end;
+   memset(&total, 0, sizeof(im_census));
+   for (tr = 0; tr < dims.tile_rows; tr++){
+      row_end = (tr + 1) * TILE_SIZE < dims.rows ? (tr + 1) * TILE_SIZE
+                                                 : dims.rows;
+      for (tc = 0; tc < dims.tile_columns; tc++){
+         tile = &board->census[tr * dims.tile_columns + tc];
+         memset(tile, 0, sizeof(im_census));
+         for (r = tr * TILE_SIZE; r < row_end; r++){
+            alive = PLANE_ROW(board->alive, r)[tc];
+            tile->population += im_popcount(alive);
+            if (board->version == immigration_life){
+               tile->yellow += im_popcount(alive
+                                           & PLANE_ROW(board->colour, r)[tc]);
             } else {
-               board[r][c].cell_color = cyan;
+               tile->yellow += im_popcount(alive
+                                           & PLANE_ROW(board->age_hi, r)[tc]);
+               tile->green += im_popcount(alive
+                                          & PLANE_ROW(board->age_lo, r)[tc]);
             }
-         } 
+         }
+         im_add_census(&total, tile);
       }
    }
+   im_set_stats(board, &total);
 }
 
-void im_print_board(square board[][COLUMNS], choice version)
+void im_add_census(im_census *total, im_census *part)
 {
-   int r, c;
-   char cell_block = '#'; 
-   int sum_red = 0, sum_yellow = 0;
-   printf("\n");
-   position_text(COLUMNS/2);
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         set_color(board[r][c].cell_color);
-         printf("%c", cell_block);
-         if (c == COLUMNS - 1){
-            printf("\n");
-            position_text(COLUMNS/2);           
-         }
+   total->population += part->population;
+   total->births += part->births;
+   total->deaths += part->deaths;
+   total->yellow += part->yellow;
+   total->green += part->green;
+}
+
+void im_set_stats(im_board *board, im_census *total)
+{
+   /* the board's stats from the census of all its tiles */
+   im_stats *s = &board->stats;
+   s->population = total->population;
+   s->births = total->births;
+   s->deaths = total->deaths;
+   s->yellow = total->yellow;
+   if (board->version == immigration_life){
+      s->red = total->population - total->yellow;
+      s->cyan = s->green = 0;
+   } else {
+      s->red = 0;
+      s->green = total->green;
+      s->cyan = total->population - total->yellow - total->green;
+   }
+}
+
+/*************************************************/
+/*            WORKER POOL FUNCTIONS              */
+/*************************************************/
+/* The threads are in life_common.c. Here a job  */
+/* of n generations costs one barrier to start   */
+/* and one barrier per generation, after which   */
+/* the bands swap boards. Rows only read the old */
+/* board, so the result matches the serial step. */
+/*************************************************/
+void im_step(rows_func rows, im_board *current, im_board *next)
+{
+   /* advances one generation, on the worker pool if there is one. */
+   /* next's hash and census are the sums of its bands' shares     */
+   band_share total;
+   tile_flag *tmp;
+   int i;
+   if (pool == NULL){
+      im_step_tiles(rows, current, next, &tiles);
+      return;
+   }
+   pool_run(pool, rows, current, next, 1);
+   total.hash = 0;
+   memset(&total.census, 0, sizeof(im_census));
+   for (i = 0; i < pool->threads; i++){
+      total.hash += job.shares[i].hash;
+      im_add_census(&total.census, &job.shares[i].census);
+      if (PROFILE){
+         profile_count(count_evaluated, job.shares[i].evaluated);
+         profile_count(count_skipped, job.shares[i].skipped);
       }
    }
-   if (version == immigration_life){
-      sum_red = cnt_red(board);
-      sum_yellow = cnt_yellow(board);
-      set_color(red);    printf("RED %d ", sum_red);
-      set_color(yellow); printf("YELLOW %d \n", sum_yellow);
-      set_color(normal);
+   next->hash = total.hash;
+   next->stats.generation = current->stats.generation + 1;
+   im_set_stats(next, &total.census);
+   tmp = tiles.changed;
+   tiles.changed = tiles.next_changed;
+   tiles.next_changed = tmp;
+}
+
+void im_step_tiles(rows_func rows, im_board *current, im_board *next,
+                   tile_map *map)
+{
+   /* one generation on the calling thread, with tile flags of its own */
+   band_share total;
+   tile_flag *tmp;
+   im_tile_rows(rows, current, next, map->changed, map->next_changed, 0,
+                dims.rows, &total);
+   if (PROFILE){
+      profile_count(count_evaluated, total.evaluated);
+      profile_count(count_skipped, total.skipped);
    }
+   next->hash = total.hash;
+   next->stats.generation = current->stats.generation + 1;
+   im_set_stats(next, &total.census);
+   tmp = map->changed;
+   map->changed = map->next_changed;
+   map->next_changed = tmp;
 }
 
-int cnt_yellow(square board[][COLUMNS])
+void job_create(pool_job *j, int threads)
 {
-   /* counts total number of yellow squares on board */
-   int r, c, sum = 0;
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         if (board[r][c].cell_color == yellow){
-            sum++;
-         }
+   j->fill = NULL;
+   j->generations = 0;
+   j->shares = malloc(threads * sizeof(band_share));
+   if (j->shares == NULL){
+      printf("***ERROR: out of memory for the worker pool***\n");
+      exit(1);
+   }
+}
+
+void job_destroy(pool_job *j)
+{
+   free(j->shares);
+   j->shares = NULL;
+}
+
+void pool_run(worker_pool *p, rows_func rows, im_board *current,
+              im_board *next, int generations)
+{
+   /* after an even number of generations the result is in current */
+   pool_job *j = p->job;
+   j->rows = rows;
+   j->current = current;
+   j->next = next;
+   j->changed = tiles.changed;
+   j->next_changed = tiles.next_changed;
+   j->generations = generations;
+   pool_post(p);
+}
+
+void pool_fill(worker_pool *p, im_board *board, uint64_t seed)
+{
+   pool_job *j = p->job;
+   j->fill = board;
+   j->fill_seed = seed;
+   pool_post(p);
+   j->fill = NULL;
+}
+
+void pool_work(worker_pool *p, int index)
+{
+   /* the job is copied out, as the caller may post the next one */
+   /* as soon as it is through the last barrier                   */
+   pool_job *j = p->job;
+   int g, generations = j->generations;
+   /* bands own whole tiles, so each tile flag has one writer */
+   int first = (int)((long)dims.tile_rows * index / p->threads) * TILE_SIZE;
+   int last = (int)((long)dims.tile_rows * (index + 1) / p->threads)
+              * TILE_SIZE;
+   rows_func rows = j->rows;
+   im_board *current = j->current, *next = j->next, *tmp;
+   tile_flag *changed = j->changed, *next_changed = j->next_changed, *flags;
+   if (j->fill != NULL){
+      im_fill_rows(j->fill, j->fill_seed, first, last);
+      pthread_barrier_wait(&p->step);
+      return;
+   }
+   for (g = 0; g < generations; g++){
+      im_tile_rows(rows, current, next, changed, next_changed, first, last,
+                   &j->shares[index]);
+      pthread_barrier_wait(&p->step);
+      tmp = current;
+      current = next;
+      next = tmp;
+      flags = changed;
+      changed = next_changed;
+      next_changed = flags;
+   }
+}
+
+/*************************************************/
+/*          CYCLE DETECTION FUNCTIONS            */
+/*************************************************/
+/* Every board made by im_step gets a 64 bit     */
+/* hash, the sum of one hash per row so that     */
+/* bands can hash their own rows. The cycle log  */
+/* of life_common.c keeps the hashes of the last */
+/* max_period boards, the first one of the run   */
+/* included, and the ring keeps the board of a   */
+/* hit to compare in full with the board p       */
+/* generations on.                               */
+/*************************************************/
+uint64_t im_hash_rows(im_board *board, int first, int last)
+{
+   /* the share of rows first .. last-1 over every plane in use; */
+   /* each plane's rows are numbered on from the last one's      */
+   size_t bytes = dims.row_words * sizeof(bitword);
+   uint64_t h = 0;
+   int r;
+   if (last > dims.rows){
+      last = dims.rows;
+   }
+   for (r = first; r < last; r++){
+      h += cycle_row_hash(PLANE_ROW(board->alive, r), bytes, r);
+      if (board->version == immigration_life){
+         h += cycle_row_hash(PLANE_ROW(board->colour, r), bytes,
+                             r + dims.rows);
+      } else {
+         h += cycle_row_hash(PLANE_ROW(board->age_lo, r), bytes,
+                             r + dims.rows);
+         h += cycle_row_hash(PLANE_ROW(board->age_hi, r), bytes,
+                             r + 2 * dims.rows);
       }
    }
-   return sum; 
+   return h;
 }
 
-int cnt_red(square board[][COLUMNS])
+void im_copy_board(im_board *to, im_board *from)
 {
-   /* counts total number of red squares on board */
-   int r, c, sum = 0;
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         if (board[r][c].cell_color == red){
-            sum++;
+   /* both boards hold the planes of one version */
+   size_t bytes = (size_t)dims.rows * dims.row_words * sizeof(bitword);
+   memcpy(to->alive, from->alive, bytes);
+   if (from->version == immigration_life){
+      memcpy(to->colour, from->colour, bytes);
+   } else {
+      memcpy(to->age_lo, from->age_lo, bytes);
+      memcpy(to->age_hi, from->age_hi, bytes);
+   }
+   to->hash = from->hash;
+   to->stats = from->stats;
+}
+
+void cycle_create(cycle_ring *ring, int size, im_board *first)
+{
+   /* size 0 looks for nothing, otherwise first is recorded */
+   cycle_log_create(&ring->log, size);
+   arena_create(&ring->store, size > 0 ? im_board_bytes(first->version) : 0);
+   if (size > 0){
+      im_alloc_board(&ring->store, &ring->kept, first->version);
+      first->hash = im_hash_rows(first, 0, dims.rows);
+      cycle_check(ring, first);
+   }
+}
+
+void cycle_destroy(cycle_ring *ring)
+{
+   cycle_log_destroy(&ring->log);
+   arena_destroy(&ring->store);
+}
+
+int cycle_check(cycle_ring *ring, im_board *board)
+{
+   /* records board, the latest one made, and returns the period   */
+   /* once a board kept from a hit holds the same cells as board,  */
+   /* otherwise 0. No more hits are taken while one is kept        */
+   if (ring->log.size == 0){
+      return 0;
+   }
+   if (cycle_due(&ring->log) && board->hash == ring->kept.hash
+       && im_iscopy(board, &ring->kept)){
+      return ring->log.pending;
+   }
+   if (cycle_record(&ring->log, board->hash, board->stats.generation)){
+      im_copy_board(&ring->kept, board);
+   }
+   return 0;
+}
+
+/*************************************************/
+/*            RANDOM FILL FUNCTIONS              */
+/*************************************************/
+/* Each row of a plane draws whole words from a  */
+/* stream of its own, see life_common.c, so the  */
+/* bands of the pool fill their rows on their    */
+/* own threads and a board only hangs on its     */
+/* seed.                                         */
+/*************************************************/
+void im_fill_rows(im_board *board, uint64_t seed, int first, int last)
+{
+   /* ors random squares into rows first .. last-1. Immigration     */
+   /* squares are yellow for all but 1 in COLOR_DENSITY of them      */
+   uint64_t alive_key, colour_key, chance = random_chance(options.density);
+   uint64_t yellow = ((uint64_t)1 << RANDOM_BITS)
+                     - random_chance(COLOR_DENSITY);
+   bitword word;
+   int r, w;
+   for (r = first; r < last && r < dims.rows; r++){
+      alive_key = random_stream(seed, r, 0);
+      colour_key = random_stream(seed, r, 1);
+      for (w = 0; w < dims.row_words; w++){
+         word = random_bits(alive_key, w, chance);
+         if (w == dims.row_words - 1 && dims.last_bits < WORD_BITS){
+            word &= ((bitword)1 << dims.last_bits) - 1;
+         }
+         PLANE_ROW(board->alive, r)[w] |= word;
+         if (board->version == immigration_life){
+            PLANE_ROW(board->colour, r)[w] |= word
+                                             & random_bits(colour_key, w,
+                                                           yellow);
          }
       }
    }
-   return sum; 
 }
 
-void im_switchpointers(square **p1, square **p2)
+/*************************************************/
+/*      HEADLESS AND BENCHMARK FUNCTIONS         */
+/*************************************************/
+/* Run a version with no intro, prompts, console */
+/* or delay, and time it. The benchmark runs     */
+/* both versions over a fixed set of sizes and   */
+/* densities and times BENCH_REPEATS runs of    */
+/* about BENCH_CELL_UPDATES square updates. A    */
+/* run is made of windows of BENCH_WINDOW        */
+/* generations, each on a board filled afresh    */
+/* and warmed up for BENCH_WARMUP untimed, so a  */
+/* small board is not timed once it has gone     */
+/* quiet and its tiles are skipped, and every    */
+/* run times the same boards.                    */
+/*************************************************/
+void print_usage(char *name)
 {
-   square *tmp;
-   tmp = *p1;
-   *p1 = *p2;
-   *p2 = tmp;
+   printf("usage: %s [-n] [-b] [-m mode] [-g generations] [-d density]\n"
+          "       %*s [-s seed] [-p period] [-c file [-i interval]]\n"
+          "       %*s [-r file] [-l rule] [-e runs] [-o file] [-v rate]\n"
+          "       %*s [-u generations] [-a file] [-j file]\n"
+          "       %*s [rows columns [threads]]\n"
+          "  -n  headless: run and time the generations, print a summary\n"
+          "  -b  run the benchmark suite\n"
+          "  -m  0 for immigration life, 1 for advanced color life\n"
+          "  -g  generations to run (default %d)\n"
+          "  -d  1 in density squares start alive (default %d)\n"
+          "  -s  seed for the random fill\n"
+          "  -p  longest period that ends a run, 0 for none (default %d)\n"
+          "  -c  write a checkpoint to a file at the end of the run\n"
+          "  -i  and every interval generations as well\n"
+          "  -r  resume from a checkpoint, its size and mode replace\n"
+          "      rows columns and -m\n"
+          "  -l  rule as B3/S23 or 23/3 (default %s)\n"
+          "  -e  play an ensemble of immigration runs, one thread per\n"
+          "      core unless threads is given\n"
+          "  -o  write phase timings of the displayed run to a file, CSV\n"
+          "      or JSON lines if it ends in .json (PROFILE builds)\n"
+          "  -v  frames a second of a displayed run, each after as many\n"
+          "      generations as fit (default every generation)\n"
+          "  -u  generations to step before the first frame is drawn\n"
+          "  -a  write each generation of a headless run to a file as\n"
+          "      a PPM frame, - for stdout\n"
+          "  -j  and as a delta log of the words that changed\n",
+          name, (int)strlen(name), "", (int)strlen(name), "",
+          (int)strlen(name), "", (int)strlen(name), "", GENERATIONS,
+          DENSITY, MAX_PERIOD, RULE);
 }
 
-bool im_iscopy(square board1[][COLUMNS], square board2[][COLUMNS])
+void im_setup(arena *a, im_board *boarda, im_board *boardb,
+              choice version)
 {
-   int r, c;
-   for (r = 0; r < ROWS; r++){
-      for(c = 0; c < COLUMNS; c++){
-         if (board1[r][c].cell_state != board2[r][c].cell_state){
-            return false;
-         } 
-      }
+   /* the boards and tile flags of one run, boarda filled at random */
+   /* or taken from the checkpoint being resumed                    */
+   arena_create(a, im_arena_bytes(version));
+   im_alloc_board(a, boarda, version);
+   im_alloc_board(a, boardb, version);
+   tiles.changed = im_alloc_tiles(a);
+   tiles.next_changed = im_alloc_tiles(a);
+   im_init_board(boarda);
+   im_init_board(boardb);
+   if (resumed.base != NULL){
+      checkpoint_restore(boarda, &resumed);
+   } else {
+      im_random_fill(boarda, options.seed);
    }
-   return true; 
+   im_census_tiles(boarda);
+   im_census_tiles(boardb);
 }
 
-/************************************************/
-/*    ADVANCED COLOR-STATE LIFE FUNCTIONS       */
-/************************************************/
-/* This version of life uses color to show the  */
-/* lifespan of the cells:                       */
-/*             birth = cyan (light blue)        */
-/*             child = green                    */
-/*             adult = yellow                   */
-/************************************************/
-void advanced_life(void)
+void im_refill(im_board *boarda, im_board *boardb, tile_map *map,
+               uint64_t seed)
 {
-   int i = 0;
-   choice version = adv_life; 
-   square boarda[ROWS][COLUMNS];
-   square boardb[ROWS][COLUMNS];
-   timespec tim, tim2;
-   tim.tv_sec = 0;
-   tim.tv_nsec = 250000000;
-   
+   /* boarda filled at random from seed, boardb and the tiles as */
+   /* though nothing had been stepped yet                         */
+   size_t count = (size_t)dims.tile_rows * dims.tile_columns;
    im_init_board(boarda);
    im_init_board(boardb);
-   im_random_fill(boarda, adv_life);
+   memset(map->changed, tile_filled, count);
+   memset(map->next_changed, tile_filled, count);
+   im_random_fill(boarda, seed);
+   im_census_tiles(boarda);
+   im_census_tiles(boardb);
+   boarda->stats.generation = boardb->stats.generation = 0;
+}
 
-   while (i++ < GENERATIONS){
-      clear_console();
-      im_print_board(boarda, adv_life);
-      nanosleep(&tim, &tim2);
-      im_next_colorstate_board(boarda, boardb);
+int im_run(choice version, im_board **current, im_board **next,
+           int generations)
+{
+   /* leaves the board generations ahead in current, or fewer if a */
+   /* stop is requested, and returns the generations taken         */
+   rows_func rows = version == immigration_life ? im_gen_rows
+                                                : im_colorstate_rows;
+   int taken = 0;
+   while (taken < generations && !stop_requested){
+      im_step(rows, *current, *next);
+      im_switchpointers(current, next);
+      taken++;
+   }
+   return taken;
+}
 
-      clear_console();
-      im_print_board(boardb, adv_life);
-      nanosleep(&tim, &tim2);
-      im_next_colorstate_board(boardb, boarda);
+void headless(void)
+{
+   /* runs options.generations with no display and reports the rate. */
+   /* The run stops early once the board is periodic, or on SIGTERM   */
+   /* or SIGINT, and leaves a checkpoint behind either way            */
+   arena boards;
+   im_board boarda, boardb, *current = &boarda, *next = &boardb;
+   cycle_ring ring;
+   checkpoint saver;
+   frame_export frames;
+   double seconds;
+   int run = 0, period = 0, jump, due;
+   bool exporting = options.image != NULL || options.delta != NULL;
 
-      if (im_iscopy(boarda,boardb)){
-         exit(0); 
+   im_setup(&boards, &boarda, &boardb, options.mode);
+   cycle_create(&ring, options.max_period, &boarda);
+   checkpoint_start(&saver, options.checkpoint, options.interval,
+                    checkpoint_planes(options.mode)
+                    * checkpoint_plane_bytes());
+   signal(SIGTERM, stop_signal);
+   signal(SIGINT, stop_signal);
+   seconds = seconds_now();
+   export_open(&frames, options.image, options.delta, options.mode);
+   export_frame(&frames, current);
+   while (run < options.generations && period == 0 && !stop_requested){
+      if (options.max_period == 0){
+         /* in one run, or one per checkpoint or exported frame */
+         jump = exporting ? 1 : options.generations - run;
+         if (saver.interval > 0){
+            due = saver.interval
+                  - (int)(current->stats.generation % saver.interval);
+            jump = jump < due ? jump : due;
+         }
+         run += im_run(options.mode, &current, &next, jump);
+      } else if (im_run(options.mode, &current, &next, 1) == 1){
+         period = cycle_check(&ring, current);
+         run++;
       }
+      checkpoint_tick(&saver, current);
+      export_frame(&frames, current);
+   }
+   export_close(&frames);
+   seconds = seconds_now() - seconds;
+
+   printf("%s %s %dx%d: %d generations in %.4f s, ",
+          options.mode == immigration_life ? "immigration" : "advanced_life",
+          rule.text, dims.rows, dims.columns, run, seconds);
+   /* red only counts in immigration, cyan and green only in color life */
+   if (options.mode == immigration_life){
+      printf("red %d yellow %d\n", current->stats.red,
+             current->stats.yellow);
+   } else {
+      printf("cyan %d green %d yellow %d\n", current->stats.cyan,
+             current->stats.green, current->stats.yellow);
    }
+   printf("last generation: %d live, %d births, %d deaths\n",
+          current->stats.population, current->stats.births,
+          current->stats.deaths);
+   if (period != 0){
+      printf("periodic with period %d at generation %llu\n", period,
+             (unsigned long long)ring.log.start);
+   }
+   if (stop_requested && run < options.generations){
+      printf("stopped at generation %llu\n",
+             (unsigned long long)current->stats.generation);
+   }
+   if (seconds > 0){
+      printf("%.1f generations/s, %.4g square updates/s\n", run / seconds,
+             (double)run * dims.rows * dims.columns / seconds);
+   }
+   checkpoint_post(&saver, current);
+   checkpoint_stop(&saver);
+   cycle_destroy(&ring);
+   arena_destroy(&boards);
 }
 
-void im_next_colorstate_board(square current[][COLUMNS], square next[][COLUMNS])
+void benchmark(void)
 {
-   /* Generates the next board based on the previous board */
-   int r, c;
-   int sum_state; 
-   for (r = 0; r < ROWS; r++){
-      for (c = 0; c < COLUMNS; c++){
-         sum_state = im_sum_state(current, r, c);
-         /* set next cell state based on previous cell state */
-         next[r][c].cell_state = next_cell_state(sum_state, 
-                         current[r][c].cell_state);
-         /* if cell is born set color to cyan */     
-         if(current[r][c].cell_state == dead && next[r][c].cell_state == alive){
-            next[r][c].cell_color = cyan;
-         }
-         /* if continues living after birth, set to green */
-         if(current[r][c].cell_color == cyan && next[r][c].cell_state == alive){
-            next[r][c].cell_color = green;
+   /* the board size given on the command line is benched first */
+   static const int sizes[][2] = {{DEFAULT_ROWS, DEFAULT_COLUMNS},
+                                  {256, 256}, {1024, 1024}};
+   static const int densities[] = {3, DENSITY, 10};
+   int rows = dims.rows, columns = dims.columns, density = options.density;
+   int max_period = options.max_period;
+   unsigned seed = options.seed;
+   int s, d;
+   choice version;
+
+   /* the rules are timed without the board hash */
+   options.max_period = 0;
+   printf("%-14s %-10s %-8s %12s %10s %12s %12s %12s\n", "mode", "size",
+          "density", "gens/s", "+-", "min", "max", "squares/s");
+   for (version = immigration_life; version <= adv_life; version++){
+      set_dimensions(rows, columns);
+      for (s = -1; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++){
+         if (s >= 0){
+            if (sizes[s][0] == rows && sizes[s][1] == columns){
+               continue;
+            }
+            set_dimensions(sizes[s][0], sizes[s][1]);
          }
-         /* if green and continues living, set color to yellow */
-         if(current[r][c].cell_color == green && next[r][c].cell_state == alive){
-            next[r][c].cell_color = yellow;
+         for (d = 0; d < (int)(sizeof(densities) / sizeof(densities[0]));
+              d++){
+            bench_case(dims.rows, dims.columns, densities[d], version);
          }
-         /* if yellow and continues living, keep same color */
-         if(current[r][c].cell_color == yellow && next[r][c].cell_state == alive){
-            next[r][c].cell_color = yellow;
-         } 
-         /* if cell dies set color to death color */
-         if(next[r][c].cell_state == dead){   
-            next[r][c].cell_color = mild_blue;
-         } 
       }
    }
+   set_dimensions(rows, columns);
+   options.density = density;
+   options.max_period = max_period;
+   options.seed = seed;
+}
+
+void bench_case(int rows, int columns, int density, choice version)
+{
+   /* one line of the benchmark: time the repeats, window by window */
+   /* from the same seeds. The spread is the mean absolute deviation */
+   /* of the rate                                                    */
+   arena boards;
+   im_board boarda, boardb, *current, *next;
+   double rate[BENCH_REPEATS], seconds, start, mean = 0, spread = 0;
+   double low = 0, high = 0;
+   int i, k, generations, done, span;
+   char size[24], ratio[16];
+
+   generations = BENCH_CELL_UPDATES / ((long)rows * columns);
+   if (generations < 8){
+      generations = 8;
+   }
+   options.density = density;
+   options.seed = BENCH_SEED;
+   im_setup(&boards, &boarda, &boardb, version);
+   for (i = 0; i < BENCH_REPEATS; i++){
+      seconds = 0;
+      for (done = k = 0; done < generations; done += span, k++){
+         span = generations - done < BENCH_WINDOW ? generations - done
+                                                  : BENCH_WINDOW;
+         im_refill(&boarda, &boardb, &tiles, (uint64_t)BENCH_SEED + k);
+         current = &boarda;
+         next = &boardb;
+         im_run(version, &current, &next, BENCH_WARMUP);
+         start = seconds_now();
+         im_run(version, &current, &next, span);
+         seconds += seconds_now() - start;
+      }
+      rate[i] = generations / (seconds > 0 ? seconds : 1e-9);
+      mean += rate[i] / BENCH_REPEATS;
+      low = i == 0 || rate[i] < low ? rate[i] : low;
+      high = i == 0 || rate[i] > high ? rate[i] : high;
+   }
+   for (i = 0; i < BENCH_REPEATS; i++){
+      spread += (rate[i] > mean ? rate[i] - mean : mean - rate[i])
+                / BENCH_REPEATS;
+   }
+   arena_destroy(&boards);
+
+   sprintf(size, "%dx%d", rows, columns);
+   sprintf(ratio, "1/%d", density);
+   printf("%-14s %-10s %-8s %12.1f %10.1f %12.1f %12.1f %12.4g\n",
+          version == immigration_life ? "immigration" : "advanced_life",
+          size, ratio, mean, spread, low, high, mean * rows * columns);
 }
 
 /*************************************************/
-/*             HELPER FUNCTIONS                  */
+/*              ENSEMBLE FUNCTIONS               */
+/*************************************************/
+/* An ensemble plays options.runs immigration    */
+/* runs, run i filled from seed options.seed+i,  */
+/* so a result does not hang on the thread that  */
+/* played it. Every thread keeps two boards and  */
+/* tile flags of its own and takes the next run  */
+/* when it is done with one, so long and short   */
+/* runs even out across the cores. A run ends    */
+/* once a color dies out, the board repeats, or  */
+/* after options.generations.                    */
+/*************************************************/
+void ensemble_run(int threads)
+{
+   /* the calling thread plays runs as well as the threads it starts */
+   ensemble e;
+   pthread_t *ids;
+   double seconds;
+   int i;
+
+   e.runs = options.runs;
+   e.next_run = 0;
+   pthread_mutex_init(&e.lock, NULL);
+   e.results = malloc(e.runs * sizeof(ensemble_result));
+   ids = malloc(threads * sizeof(pthread_t));
+   if (e.results == NULL || ids == NULL){
+      printf("***ERROR: out of memory for the ensemble***\n");
+      exit(1);
+   }
+   for (i = 0; i < e.runs; i++){
+      e.results[i].outcome = unplayed;
+      e.results[i].generation = 0;
+   }
+   signal(SIGTERM, stop_signal);
+   signal(SIGINT, stop_signal);
+   seconds = seconds_now();
+   for (i = 1; i < threads; i++){
+      if (pthread_create(&ids[i], NULL, ensemble_thread, &e) != 0){
+         printf("***ERROR: could not start an ensemble thread***\n");
+         exit(1);
+      }
+   }
+   ensemble_thread(&e);
+   for (i = 1; i < threads; i++){
+      pthread_join(ids[i], NULL);
+   }
+   seconds = seconds_now() - seconds;
+
+   ensemble_report(&e, threads, seconds);
+   pthread_mutex_destroy(&e.lock);
+   free(ids);
+   free(e.results);
+}
+
+void *ensemble_thread(void *arg)
+{
+   /* plays runs until there are none left, or a stop is asked for */
+   ensemble *e = arg;
+   arena boards;
+   im_board boarda, boardb;
+   tile_map map;
+   int run;
+
+   arena_create(&boards, im_arena_bytes(immigration_life));
+   im_alloc_board(&boards, &boarda, immigration_life);
+   im_alloc_board(&boards, &boardb, immigration_life);
+   map.changed = im_alloc_tiles(&boards);
+   map.next_changed = im_alloc_tiles(&boards);
+   while (true){
+      pthread_mutex_lock(&e->lock);
+      run = stop_requested ? e->runs : e->next_run;
+      if (run < e->runs){
+         e->next_run++;
+      }
+      pthread_mutex_unlock(&e->lock);
+      if (run >= e->runs){
+         break;
+      }
+      ensemble_play(&boarda, &boardb, &map, (uint64_t)options.seed + run,
+                    &e->results[run]);
+   }
+   arena_destroy(&boards);
+   return NULL;
+}
+
+void ensemble_play(im_board *boarda, im_board *boardb, tile_map *map,
+                   uint64_t seed, ensemble_result *result)
+{
+   /* one run on boards already allocated, filled again from seed */
+   im_board *current = boarda, *next = boardb;
+   cycle_ring ring;
+   im_stats *s;
+   int period = 0;
+
+   im_refill(boarda, boardb, map, seed);
+   cycle_create(&ring, options.max_period, boarda);
+   s = &current->stats;
+   while (s->red > 0 && s->yellow > 0 && period == 0
+          && s->generation < (uint64_t)options.generations){
+      im_step_tiles(im_gen_rows, current, next, map);
+      im_switchpointers(&current, &next);
+      s = &current->stats;
+      period = cycle_check(&ring, current);
+   }
+   cycle_destroy(&ring);
+
+   /* a color that has died out can not be born again */
+   result->generation = (int)s->generation;
+   if (s->population == 0){
+      result->outcome = all_dead;
+   } else if (s->yellow == 0){
+      result->outcome = red_wins;
+   } else if (s->red == 0){
+      result->outcome = yellow_wins;
+   } else if (period != 0){
+      result->outcome = periodic;
+   } else {
+      result->outcome = undecided;
+   }
+}
+
+void ensemble_report(ensemble *e, int threads, double seconds)
+{
+   /* the share of each outcome with a 95% interval, and the spread */
+   /* of the generations a color took to win                        */
+   static const char *names[] = {"red wins", "yellow wins", "all dead",
+                                 "periodic", "undecided"};
+   int counts[unplayed], *times, played = 0, won = 0, i;
+   double mean = 0, spread = 0, low, high;
+
+   times = malloc((e->runs > 0 ? e->runs : 1) * sizeof(int));
+   if (times == NULL){
+      printf("***ERROR: out of memory for the ensemble***\n");
+      exit(1);
+   }
+   memset(counts, 0, sizeof(counts));
+   for (i = 0; i < e->runs; i++){
+      if (e->results[i].outcome == unplayed){
+         continue;
+      }
+      counts[e->results[i].outcome]++;
+      played++;
+      if (e->results[i].outcome == red_wins
+          || e->results[i].outcome == yellow_wins){
+         times[won++] = e->results[i].generation;
+         mean += e->results[i].generation;
+      }
+   }
+
+   printf("ensemble %s %dx%d: %d runs of up to %d generations in %.4f s "
+          "on %d threads\n", rule.text, dims.rows, dims.columns, played,
+          options.generations, seconds, threads);
+   for (i = 0; i < unplayed; i++){
+      ensemble_interval(counts[i], played, &low, &high);
+      printf("%-12s %8d  %.4f  (95%% %.4f - %.4f)\n", names[i], counts[i],
+             played > 0 ? (double)counts[i] / played : 0.0, low, high);
+   }
+   if (won > 0){
+      mean /= won;
+      for (i = 0; i < won; i++){
+         spread += (times[i] - mean) * (times[i] - mean);
+      }
+      spread = won > 1 ? ensemble_sqrt(spread / (won - 1)) : 0;
+      qsort(times, won, sizeof(int), ensemble_compare);
+      printf("generations to win: mean %.1f sd %.1f\n", mean, spread);
+      printf("  min %d p10 %d p25 %d median %d p75 %d p90 %d max %d\n",
+             times[0], times[(won - 1) / 10], times[(won - 1) / 4],
+             times[(won - 1) / 2], times[(won - 1) * 3 / 4],
+             times[(won - 1) * 9 / 10], times[won - 1]);
+   }
+   if (stop_requested){
+      printf("stopped after %d of %d runs\n", played, e->runs);
+   }
+   if (seconds > 0){
+      printf("%.1f runs/s\n", played / seconds);
+   }
+   free(times);
+}
+
+void ensemble_interval(int hits, int runs, double *low, double *high)
+{
+   /* the Wilson score interval, which stays inside 0 .. 1 and is */
+   /* sound for the rare outcomes of a few runs                    */
+   double p, z2 = ENSEMBLE_Z * ENSEMBLE_Z, centre, half;
+   if (runs == 0){
+      *low = 0;
+      *high = 1;
+      return;
+   }
+   p = (double)hits / runs;
+   centre = (p + z2 / (2 * runs)) / (1 + z2 / runs);
+   half = ENSEMBLE_Z * ensemble_sqrt(p * (1 - p) / runs
+                                     + z2 / (4.0 * runs * runs))
+          / (1 + z2 / runs);
+   *low = centre - half > 0 ? centre - half : 0;
+   *high = centre + half < 1 ? centre + half : 1;
+}
+
+double ensemble_sqrt(double x)
+{
+   /* Newton's method, so the program needs no maths library */
+   double root = x > 1 ? x : 1;
+   int i;
+   if (x <= 0){
+      return 0;
+   }
+   for (i = 0; i < 64; i++){
+      root = (root + x / root) / 2;
+   }
+   return root;
+}
+
+int ensemble_compare(const void *a, const void *b)
+{
+   int x = *(const int *)a, y = *(const int *)b;
+   return (x > y) - (x < y);
+}
+
+/*************************************************/
+/*           BOARD STORAGE FUNCTIONS             */
 /*************************************************/
-void position_text(int offset)
+/* The board size is set once at start up and    */
+/* both boards come from one arena whose blocks  */
+/* start on a cache line. The same two boards    */
+/* are swapped for every generation.             */
+/*************************************************/
+bool set_dimensions(int rows, int columns)
 {
-   int i, con_w = console_width(); 
-   for (i = 0; i < (con_w/2-offset); i++){
-      printf(" ");
+   if (rows < 1 || columns < 1){
+      return false;
    }
+   dims.rows = rows;
+   dims.columns = columns;
+   dims.row_words = (columns + WORD_BITS - 1) / WORD_BITS;
+   dims.last_bits = columns - (dims.row_words - 1) * WORD_BITS;
+   dims.tile_rows = (rows + TILE_SIZE - 1) / TILE_SIZE;
+   dims.tile_columns = dims.row_words;
+   return true;
+}
+
+size_t im_board_bytes(choice version)
+{
+   /* 2 planes for immigration, 3 for color life, and the tile */
+   /* census, each cache aligned                               */
+   size_t planes = version == immigration_life ? 2 : 3;
+   return planes * ((size_t)dims.rows * dims.row_words * sizeof(bitword)
+                    + CACHE_LINE)
+          + (size_t)dims.tile_rows * dims.tile_columns * sizeof(im_census)
+          + CACHE_LINE;
+}
+
+size_t im_arena_bytes(choice version)
+{
+   /* two boards and two sets of tile flags, each cache aligned */
+   return 2 * im_board_bytes(version)
+          + 2 * ((size_t)dims.tile_rows * dims.tile_columns + CACHE_LINE);
 }
 
-void set_color(int color_choice)
+void im_alloc_board(arena *a, im_board *board, choice version)
 {
-   switch(color_choice){
-   case blue:
-      printf("\033[1;34m");
-      break;
-   case mild_blue:
-      printf("\033[0;34m");
-      break;
-   case red:
-      printf("\033[1;31m");
-      break;
-   case yellow:
-      printf("\033[1;33m");
-      break;
-   case cyan:
-      printf("\033[1;36m");
-      break;
-   case green:
-      printf("\033[1;32m");
-      break;
-   case magenta:
-      printf("\033[1;35m");
-      break;
-   default:
-      printf("\033[0m");
+   /* only the planes the version uses */
+   size_t bytes = (size_t)dims.rows * dims.row_words * sizeof(bitword);
+   board->version = version;
+   board->hash = 0;
+   memset(&board->stats, 0, sizeof(im_stats));
+   board->census = arena_alloc(a, (size_t)dims.tile_rows * dims.tile_columns
+                                  * sizeof(im_census));
+   board->alive = arena_alloc(a, bytes);
+   board->colour = board->age_lo = board->age_hi = NULL;
+   if (version == immigration_life){
+      board->colour = arena_alloc(a, bytes);
+   } else {
+      board->age_lo = arena_alloc(a, bytes);
+      board->age_hi = arena_alloc(a, bytes);
    }
 }
 
-void clear_console(void)
+/*************************************************/
+/*            CHECKPOINT FUNCTIONS               */
+/*************************************************/
+/* A checkpoint is a CHECKPOINT_HEADER byte      */
+/* header and then the board's bit planes just   */
+/* as im_board holds them, which life_common.c   */
+/* writes in the background. A run resumes by    */
+/* mapping the file and stepping from            */
+/* the mapped planes themselves: the pages are   */
+/* private and only copied once written to.      */
+/*************************************************/
+size_t checkpoint_plane_bytes(void)
 {
-   if (!system("clear")){
-      printf(" ");
-   } 
+   return (size_t)dims.rows * dims.row_words * sizeof(bitword);
 }
 
-int console_width(void)
+int checkpoint_planes(choice version)
 {
-   struct winsize w;
-   ioctl(0, TIOCGWINSZ, &w);
-   return w.ws_col;
+   return version == immigration_life ? 2 : 3;
 }
 
+void checkpoint_tick(checkpoint *ck, im_board *board)
+{
+   /* called with each new board, posts every interval generations */
+   if (ck->interval > 0 && board->stats.generation % ck->interval == 0){
+      checkpoint_post(ck, board);
+   }
+}
+
+void checkpoint_post(checkpoint *ck, im_board *board)
+{
+   /* copies board into the buffer once the writer is done with */
+   /* the last one, and hands it over                          */
+   checkpoint_header *header;
+   unsigned char *plane = ck->buffer + CHECKPOINT_HEADER;
+   size_t bytes = checkpoint_plane_bytes();
+   if (ck->path == NULL){
+      return;
+   }
+   header = checkpoint_claim(ck);
+   header->mode = board->version;
+   header->rows = dims.rows;
+   header->columns = dims.columns;
+   header->generation = board->stats.generation;
+   header->seed = options.seed;
+   header->planes = checkpoint_planes(board->version);
+   header->row_words = dims.row_words;
+   header->birth = rule.birth;
+   header->survive = rule.survive;
+   memcpy(plane, board->alive, bytes);
+   if (board->version == immigration_life){
+      memcpy(plane + bytes, board->colour, bytes);
+   } else {
+      memcpy(plane + bytes, board->age_lo, bytes);
+      memcpy(plane + 2 * bytes, board->age_hi, bytes);
+   }
+   checkpoint_hand_over(ck);
+}
+
+void checkpoint_open(checkpoint_map *map, char *path)
+{
+   /* maps the file, which must hold the planes of one version */
+   checkpoint_header *h;
+   bool sound = checkpoint_map_file(map, path);
+   h = map->header;
+   if (!sound || (h->mode != immigration_life && h->mode != adv_life)
+       || h->planes != (uint32_t)checkpoint_planes(h->mode)){
+      printf("***ERROR: %s is not a life_extra checkpoint of this "
+             "version***\n", path);
+      exit(1);
+   }
+}
+
+void checkpoint_restore(im_board *board, checkpoint_map *map)
+{
+   /* the board's planes become the mapped ones. The bits past the */
+   /* last column must be clear, which only a damaged file breaks  */
+   size_t i, words = (size_t)dims.rows * dims.row_words;
+   bitword mask = ~(bitword)0 >> (WORD_BITS - dims.last_bits);
+   int p;
+   board->alive = map->planes;
+   if (board->version == immigration_life){
+      board->colour = map->planes + words;
+   } else {
+      board->age_lo = map->planes + words;
+      board->age_hi = map->planes + 2 * words;
+   }
+   for (p = 0; p < checkpoint_planes(board->version); p++){
+      for (i = dims.row_words - 1; i < words; i += dims.row_words){
+         if (map->planes[p * words + i] & ~mask){
+            map->planes[p * words + i] &= mask;
+         }
+      }
+   }
+   board->stats.generation = map->header->generation;
+}
+
+/***********************************************/
+/*            FRAME EXPORT FUNCTIONS           */
+/***********************************************/
+/* A headless run can write every generation as*/
+/* it steps. -a gives a stream of binary PPM   */
+/* frames in the colors of the terminal, that  */
+/* an encoder can read from a pipe. The bits a */
+/* square has in the planes pick its color from*/
+/* a palette, so no square is formatted on its */
+/* own. -j gives the delta log of              */
+/* life_common.c, with every plane of the      */
+/* version. The first generation is XORed with */
+/* an empty board. Either can be - for stdout, */
+/* and the summary goes to stderr instead.     */
+/***********************************************/
+void export_open(frame_export *x, char *image, char *delta, choice version)
+{
+   static const color ages[] = {cyan, green, yellow, yellow};
+   color shade;
+   int i;
+   x->image = image != NULL ? export_file(image) : NULL;
+   x->delta = delta != NULL ? export_file(delta) : NULL;
+   if (x->image == NULL && x->delta == NULL){
+      return;
+   }
+   x->planes = checkpoint_planes(version);
+   x->shown = calloc((size_t)x->planes * dims.rows * dims.row_words,
+                     sizeof(bitword));
+   x->pixels = malloc((size_t)dims.columns * 3);
+   if (x->shown == NULL || x->pixels == NULL){
+      printf("***ERROR: out of memory for the frames***\n");
+      exit(1);
+   }
+   /* the same colors im_color_at draws in */
+   for (i = 0; i < 8; i++){
+      if (!(i & 1)){
+         shade = mild_blue;
+      } else if (version == immigration_life){
+         shade = i & 2 ? yellow : red;
+      } else {
+         shade = ages[i >> 1];
+      }
+      memcpy(x->palette[i], color_rgb[shade], 3);
+   }
+   if (x->delta != NULL){
+      export_header(x->delta, x->planes, dims.rows, dims.columns,
+                    dims.row_words);
+   }
+}
+
+void export_frame(frame_export *x, im_board *board)
+{
+   if (x->image != NULL){
+      export_image(x, board);
+   }
+   if (x->delta != NULL){
+      export_delta(x, board);
+   }
+}
+
+void export_image(frame_export *x, im_board *board)
+{
+   /* the planes give each square 3 bits, alive lowest, that pick */
+   /* its color from the palette                                  */
+   int r, c, i;
+   bitword alive, first, second;
+   bitword *planes[2];
+   planes[0] = board->version == immigration_life ? board->colour
+                                                  : board->age_lo;
+   planes[1] = board->version == immigration_life ? NULL : board->age_hi;
+   fprintf(x->image, "P6\n%d %d\n255\n", dims.columns, dims.rows);
+   for (r = 0; r < dims.rows; r++){
+      for (c = 0; c < dims.columns; c += WORD_BITS){
+         alive = PLANE_ROW(board->alive, r)[c / WORD_BITS];
+         first = PLANE_ROW(planes[0], r)[c / WORD_BITS];
+         second = planes[1] != NULL ? PLANE_ROW(planes[1], r)[c / WORD_BITS]
+                                    : 0;
+         for (i = 0; i < WORD_BITS && c + i < dims.columns; i++){
+            memcpy(x->pixels + 3 * (c + i),
+                   x->palette[((alive >> i) & 1) | ((first >> i) & 1) << 1
+                              | ((second >> i) & 1) << 2], 3);
+         }
+      }
+      fwrite(x->pixels, 3, dims.columns, x->image);
+   }
+}
+
+void export_delta(frame_export *x, im_board *board)
+{
+   /* shown is left holding this generation's planes */
+   size_t words = (size_t)dims.rows * dims.row_words;
+   bitword *now;
+   int p;
+   fwrite(&board->stats.generation, sizeof(uint64_t), 1, x->delta);
+   for (p = 0; p < x->planes; p++){
+      now = p == 0 ? board->alive
+            : board->version == immigration_life ? board->colour
+            : p == 1 ? board->age_lo : board->age_hi;
+      export_plane(x->delta, now, x->shown + p * words, words);
+   }
+}
+
+void export_close(frame_export *x)
+{
+   if (x->image == NULL && x->delta == NULL){
+      return;
+   }
+   if ((x->image != NULL && fclose(x->image) != 0)
+       || (x->delta != NULL && fclose(x->delta) != 0)){
+      printf("***ERROR: cannot write frames***\n");
+   }
+   free(x->shown);
+   free(x->pixels);
+}
+
+/*************************************************/
+/*             HELPER FUNCTIONS                  */
+/*************************************************/
 void print_intro(void)
 {
    clear_console();
    printf("\n\n");
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("            THE GAME OF");
    set_color(blue);
    printf(" LIFE\n");
    set_color(red);
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("           cellular automaton\n\n");
 }
 
@@ -509,7 +2145,7 @@ choice get_choice(void)
 
    set_color(normal);
    printf("\n");
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("    For ");
    set_color(yellow);
    printf("IMMIGRATION LIFE");
@@ -520,7 +2156,7 @@ choice get_choice(void)
 
    set_color(normal);
    printf("\n");
-   position_text(COLUMNS/2);
+   position_text(DEFAULT_COLUMNS/2);
    printf("    For ");
    set_color(cyan);
    printf("ADVANCED COLOR LIFE");